@@ -1,12 +1,21 @@
 #include <iostream>
 #include <string>
+#include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 #include <sys/time.h>
 #include "utils.h"
 #include "masks.h"
 #include "movegen.h"
 #include "eval.h"
+#include "nnue.h"
 #include "engine.h"
 
 using std::cout;
@@ -18,16 +27,94 @@ Engine::Engine()
 	resetEngine();
 }
 
-void Engine::search(Game curerntGame, int depth)
+// Helper threads share the main thread's transposition table instead of allocating their own
+Engine::Engine(Engine * main, int id)
+{
+	threadId = id;
+	mainThread = main;
+	nodes = 0, ply = 0, bestEval = 0, inPV = 0, scorePV = 0, repetitionIndex = 0, duration = 0, nps = 0, stopped = 0;
+
+	memset(killerMoves, 0, sizeof(killerMoves));
+	memset(historyMoves, 0, sizeof(historyMoves));
+	memset(pvLength, 0, sizeof(pvLength));
+	memset(pvTable, 0, sizeof(pvTable));
+	memset(repetitionTable, 0, sizeof(repetitionTable));
+
+	tt = main -> tt;
+	hashBuckets = main -> hashBuckets;
+	evalCache = main -> evalCache;
+	evalCacheProbes = 0, evalCacheHits = 0;
+}
+
+void Engine::setThreads(int count)
+{
+	// The helpers are owned by the main engine, dropping them frees them
+	helpers.clear();
+
+	threadCount = count;
+	for (int id = 1; id < threadCount; id ++)
+	{
+		helpers.push_back(std::make_unique<Engine>(this, id));
+	}
+}
+
+// Percentage of static evaluations found in the eval cache, over all threads
+int Engine::evalCacheHitRate()
+{
+	uint64_t probes = evalCacheProbes.load(std::memory_order_relaxed);
+	uint64_t hits = evalCacheHits.load(std::memory_order_relaxed);
+	for (const std::unique_ptr<Engine>& helper : helpers)
+	{
+		probes += helper -> evalCacheProbes.load(std::memory_order_relaxed);
+		hits += helper -> evalCacheHits.load(std::memory_order_relaxed);
+	}
+	return (probes > 0 ? (int)(hits * 100 / probes) : 0);
+}
+
+// Nodes searched by the main thread and all helper threads
+uint64_t Engine::totalNodes()
+{
+	uint64_t total = nodes.load(std::memory_order_relaxed);
+	for (const std::unique_ptr<Engine>& helper : helpers)
+	{
+		total += helper -> nodes.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+void Engine::search(const Game& curerntGame, int depth)
 {
 	game = curerntGame;	
-	nodes = 0, ply = 0, bestEval = 0, inPV = 0, scorePV = 0, duration = 0, knps = 0, stopped = 0;
+	nodes = 0, ply = 0, bestEval = 0, inPV = 0, scorePV = 0, duration = 0, nps = 0, stopped = 0;
+	evalCacheProbes = 0, evalCacheHits = 0;
+
+	// The table is normally mapped by setoption or isready, this only covers a go sent without either
+	if (threadId == 0 && tt == NULL) { initTranspositionTable(hashMb); }
+
+	// Entries written by earlier searches age and become the first ones to be replaced
+	if (threadId == 0 && !hashShared) { hashGeneration = (hashGeneration + 1) % HASH_GENERATIONS; }
 
 	memset(killerMoves, 0, sizeof(killerMoves));
 	memset(historyMoves, 0, sizeof(historyMoves));
 	memset(pvLength, 0, sizeof(pvLength));
 	memset(pvTable, 0, sizeof(pvTable));
 
+	// The accumulator stack belongs to the thread, so each search starts from a fresh accumulator
+	if (NNUE::enabled) { NNUE::refreshAccumulator(game); }
+
+	// Lazy SMP: start the helper threads on the same position, they only communicate with us through the transposition table
+	std::vector<std::thread> threads;
+	for (const std::unique_ptr<Engine>& helper : helpers)
+	{
+		helper -> tt = tt;
+		helper -> hashBuckets = hashBuckets;
+		helper -> hashGeneration = hashGeneration;
+		helper -> evalCache = evalCache;
+		helper -> repetitionIndex = repetitionIndex;
+		memcpy(helper -> repetitionTable, repetitionTable, sizeof(repetitionTable));
+		threads.push_back(std::thread(&Engine::search, helper.get(), curerntGame, depth));
+	}
+
 	int alpha = -INF;
 	int beta = INF;
 
@@ -35,15 +122,18 @@ void Engine::search(Game curerntGame, int depth)
 	{
 		if (stopped == 1) { break; }
 
+		// Half of the helper threads search one ply deeper so that the threads don't all walk the same tree
+		int searchDepth = currentDepth + (threadId & 1);
+
 		// Follow the principle variation by default
 		inPV = 1;
-		// Run the principle variation search and measure the time
-		clock_t startTime = clock();
-		bestEval = PVS(currentDepth, alpha, beta);
-		clock_t endTime = clock();	
-		// Calculate the time and kilo nodes per second
-		duration = (endTime - startTime) * 1000 / CLOCKS_PER_SEC;
-		knps = nodes / duration;
+		// Run the principle variation search and measure the time (wall clock, cpu time would add up over all threads)
+		int startTime = getTimems();
+		bestEval = PVS(searchDepth, alpha, beta);
+		int endTime = getTimems();
+		// Calculate the time and nodes per second
+		duration = endTime - startTime;
+		nps = totalNodes() * 1000 / (duration > 0 ? duration : 1);
 
 		if ((bestEval <= alpha) || (bestEval >= beta))
 		{
@@ -55,17 +145,190 @@ void Engine::search(Game curerntGame, int depth)
 		alpha = bestEval - ASPIRATION_WINDOW_SIZE;
 		beta = bestEval + ASPIRATION_WINDOW_SIZE;
 
-		if (pvLength[0])
+		if (pvLength[0] && threadId == 0)
 		{
 			// Second parameter toggles debug mode
 			printResults(currentDepth, depth, DEBUG_ENGINE);			
 		}
 	}
+
+	// The main thread is done, so tell the helper threads to stop and wait for them
+	if (threadId == 0)
+	{
+		stopped = 1;
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+// Search a fixed set of positions to a fixed depth and report the node count and speed, used to measure search speed between builds
+void Engine::bench(int depth)
+{
+	uint64_t totalNodesSearched = 0;
+	int totalTime = 0;
+
+	timeset = 0;
+	benchmarking = 1;
+
+	// Map the table before the clock starts, so the first position isn't charged for it
+	if (tt == NULL) { initTranspositionTable(hashMb); }
+
+	for (int i = 0; i < BENCH_POSITION_COUNT; i ++)
+	{
+		Game benchGame(BENCH_POSITIONS[i]);
+		// A shared table belongs to every process attached to it, so it's left alone (and the node counts aren't reproducible)
+		if (!hashShared) { clearTranspositionTable(); }
+		repetitionIndex = 0;
+
+		cout << "Position " << i + 1 << "/" << BENCH_POSITION_COUNT << ": " << BENCH_POSITIONS[i] << endl;
+
+		int startTime = getTimems();
+		search(benchGame, depth);
+		totalTime += getTimems() - startTime;
+		totalNodesSearched += totalNodes();
+	}
+
+	benchmarking = 0;
+
+	cout << "========================" << endl;
+	cout << "Total time: " << totalTime << " ms" << endl;
+	cout << "Nodes searched: " << totalNodesSearched << endl;
+	cout << "Nodes per second: " << totalNodesSearched * 1000 / (totalTime > 0 ? totalTime : 1) << endl;
+	cout << "========================" << endl;
+}
+
+// Time the bishop and rook look ups of the slider backend this build uses. The backend is fixed at compile time, 
+// so comparing them takes one build each (make bench-sliders)
+void Engine::benchSliders()
+{
+	// Random occupancies with about as many pieces as a middlegame position (xorshift, so every build times the same ones)
+	static Bitboard occupancies[SLIDER_BENCH_OCCUPANCIES];
+	uint64_t state = 88172645463325252ull;
+	for (int i = 0; i < SLIDER_BENCH_OCCUPANCIES; i ++)
+	{
+		occupancies[i] = 0;
+		for (int j = 0; j < 25; j ++)
+		{
+			state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+			occupancies[i] |= 1ull << (state & 63);
+		}
+	}
+
+	// Each round does three look ups, the last one depends on the previous results so they can't all be overlapped
+	Bitboard sink = 0;
+	int startTime = getTimems();
+	for (int round = 0; round < SLIDER_BENCH_ROUNDS; round ++)
+	{
+		for (int i = 0; i < SLIDER_BENCH_OCCUPANCIES; i ++)
+		{
+			Bitboard occupancy = occupancies[i];
+			int square = (i * 7 + round) & 63;
+			sink ^= generateRookAttacks(square, occupancy) ^ generateBishopAttacks(square ^ 13, occupancy) ^ 
+				generateRookAttacks(square ^ 37, sink & occupancy);
+		}
+	}
+	int totalTime = getTimems() - startTime;
+	uint64_t lookups = 3ull * SLIDER_BENCH_ROUNDS * SLIDER_BENCH_OCCUPANCIES;
+
+	cout << "========================" << endl;
+	cout << "Slider attacks: " << SLIDER_ATTACKS_NAME << endl;
+	cout << "Look ups: " << lookups << " (checksum " << (sink & 0xFFFF) << ")" << endl;
+	cout << "Total time: " << totalTime << " ms" << endl;
+	cout << "Nanoseconds per look up: " << totalTime * 1000000.0 / lookups << endl;
+	cout << "========================" << endl;
+}
+
+// The insertion sort the move lists used to be ordered with (two scoreMove calls per comparison), kept as the baseline of bench ordering
+static void insertionSortMoves(Engine& engine, MoveList& moveList)
+{
+	for (int i = 1; i < moveList.count; i++)
+	{
+		for (int j = i; j > 0 && engine.scoreMove(moveList.moves[j], 0) > engine.scoreMove(moveList.moves[j - 1], 0); j--)
+		{
+			std::swap(moveList.moves[j], moveList.moves[j - 1]);
+		}
+	}
+}
+
+// Time ordering quiet move lists from random games: the old insertion sort, scoring once and picking every move, 
+// and scoring once and picking only two moves (a node that cuts off early)
+void Engine::benchMoveOrdering()
+{
+	// Quiet moves of the positions met in random games from the bench positions (xorshift, so every run times the same ones)
+	std::vector<MoveList> moveListsToOrder;
+	uint64_t state = 88172645463325252ull;
+	for (int i = 0; i < BENCH_POSITION_COUNT; i ++)
+	{
+		for (int j = 0; j < ORDERING_BENCH_GAMES; j ++)
+		{
+			Game benchGame(BENCH_POSITIONS[i]);
+			for (int k = 0; k < ORDERING_BENCH_PLIES; k ++)
+			{
+				MoveList moveList;
+				benchGame.generateAllMoves(moveList);
+				if (moveList.count == 0) { break; }
+
+				moveListsToOrder.emplace_back();
+				benchGame.generateAllMoves(moveListsToOrder.back(), ONLY_QUIETS);
+
+				state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+				benchGame.makeMove(moveList.moves[state % moveList.count]);
+			}
+		}
+	}
+
+	// History scores like the ones of a search, so that the moves don't all tie
+	ply = 0, scorePV = 0;
+	memset(killerMoves, 0, sizeof(killerMoves));
+	for (int piece = P; piece <= k; piece ++)
+	{
+		for (int square = 0; square < 64; square ++)
+		{
+			state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+			historyMoves[piece][square] = state % 200;
+		}
+	}
+
+	const char* methods[3] = {"insertion sort", "score once, pick all", "score once, pick two"};
+	cout << "========================" << endl;
+	cout << "Move lists: " << moveListsToOrder.size() << " x " << ORDERING_BENCH_ROUNDS << endl;
+	for (int method = 0; method < 3; method ++)
+	{
+		uint64_t sink = 0;
+		int startTime = getTimems();
+		for (int round = 0; round < ORDERING_BENCH_ROUNDS; round ++)
+		{
+			for (const MoveList& moves : moveListsToOrder)
+			{
+				MoveList moveList;
+				moveList.count = moves.count;
+				memcpy(moveList.moves, moves.moves, moves.count * sizeof(int));
+
+				if (method == 0) 
+				{
+					insertionSortMoves(*this, moveList);
+					sink += moveList.moves[0];
+				}
+				else
+				{
+					scoreMoves(moveList);
+					int picks = (method == 1 ? moveList.count : std::min(2, moveList.count));
+					for (int i = 0; i < picks; i ++) { sink += pickBestMove(moveList, i); }
+				}
+			}
+		}
+		cout << methods[method] << ": " << getTimems() - startTime << " ms (checksum " << (sink & 0xFFFF) << ")" << endl;
+	}
+	cout << "========================" << endl;
+
+	memset(historyMoves, 0, sizeof(historyMoves));
 }
 
 int Engine::PVS(int depth, int alpha, int beta)
 {
-	if ((nodes & 2047) == 0)
+	if ((nodes.load(std::memory_order_relaxed) & 2047) == 0)
 	{
 		communicate();
 	}
@@ -74,15 +337,15 @@ int Engine::PVS(int depth, int alpha, int beta)
 	int bestMove = 0;
 	int hashFlag = HASH_ALPHA;
 	int pvNode = (beta - alpha > 1);
-	int staticEval = evaluate(game);
+	int staticEval = staticEvaluation();
 	int legalMoves = 0;
-	int isInCheck = game.isSquareAttacked(getLeastSignificantBitIndex((game.side == WHITE ? game.bitboards[K] : game.bitboards[k])), game.side ^ 1);
+	int isInCheck = (game.checkers != 0);
 
 	pvLength[ply] = ply;
 
 	score = readHashEntry(depth, alpha, beta, bestMove);
 
-	if (ply > 0 && (isRepetition() || game.fiftyMoveRuleCount >= 50)) { return 0; }
+	if (ply > 0 && (isRepetition() || game.fiftyMoveRuleCount >= 50 || isMaterialDraw(game))) { return 0; }
 	if (ply > 0 && score != NO_HASH_ENTRY && !pvNode) { return score; }
 
 	// Check for all captures possible at the end of the search 
@@ -90,7 +353,7 @@ int Engine::PVS(int depth, int alpha, int beta)
 
 	if (ply > MAX_PLY - 1) { return staticEval; }
 
-	nodes ++;
+	countNode();
 
 	if (isInCheck) { depth ++; }
 
@@ -113,6 +376,7 @@ int Engine::PVS(int depth, int alpha, int beta)
 		repetitionTable[repetitionIndex] = game.hashKey;
 
 		GameState prevState = game.makeNullMove();
+		prefetchHashEntry(game.hashKey);
 		score = -PVS(depth - 1 - NULL_MOVE_REDUCTION, -beta, -beta + 1);
 		game.takeBack(prevState);
 		ply --;
@@ -152,33 +416,41 @@ int Engine::PVS(int depth, int alpha, int beta)
 		}
 	}
 
-	game.generateAllMoves();
-
 	// Make sure that we are actually inside PV before we switch on score PV move flag
 	if (inPV) { enablePVScoring(); }
 
-	sortMoves(game.moveList, bestMove);
-	int *move = game.moveList;
+	// Moves are generated stage by stage, so a cutoff by the hash move doesn't generate anything
+	MovePicker picker;
+	initMovePicker(picker, bestMove, ALL_MOVES);
+	int move;
 	int movesSearched = 0;
 
-	while (*move)
+	while ((move = pickNextMove(picker)) != 0)
 	{
+		// Quiet moves that put the piece where it is lost in the exchange (checked before the move is made)
+		int losingQuiet = (depth <= 3 && !pvNode && isInCheck == 0 && movesSearched > 0 && getCaptureFlag(move) == 0 &&
+						   getPromotion(move) == NULL_PIECE && staticExchangeEvaluation(move) < -50 * depth);
+
 		ply ++;
 
 		repetitionIndex ++;
 		repetitionTable[repetitionIndex] = game.hashKey;
 
-		GameState prevState = game.makeMove(*move, ALL_MOVES);
-		if (!prevState.valid)
+		// The picker only returns legal moves
+		GameState prevState = game.makeMove(move, ALL_MOVES);
+		prefetchHashEntry(game.hashKey);
+		legalMoves ++;
+
+		int moveIsCheck = (game.checkers != 0);
+
+		// Prune them near the leaves unless they give check
+		if (losingQuiet && moveIsCheck == 0)
 		{
+			game.takeBack(prevState);
 			ply --;
 			repetitionIndex --;
-			move ++;
 			continue;
 		}
-		legalMoves ++;
-
-		int moveIsCheck = game.isSquareAttacked(getLeastSignificantBitIndex((game.side == WHITE ? game.bitboards[K] : game.bitboards[k])), game.side ^ 1);
 
 		// Only do the full window search for the first move (supposedly the best move because we are following the principle variation)
 		if (movesSearched == 0)	
@@ -192,7 +464,7 @@ int Engine::PVS(int depth, int alpha, int beta)
 			// Do not reduce leaf nodes, moves that leave king in check, moves that gives checks, 
 			// moves that are captures/promotions, and moves that are in the principle variation
 			if (movesSearched >= FULL_DEPTH_MOVES && depth >= REDUCTION_LIMIT && isInCheck == 0 && moveIsCheck == 0 && 
-				getCaptureFlag(*move) == 0 && getPromotion(*move) == NULL_PIECE && *move != pvTable[0][ply])
+				getCaptureFlag(move) == 0 && getPromotion(move) == NULL_PIECE && move != pvTable[0][ply])
 			{
 				score = -PVS(depth - 2, -alpha - 1, -alpha);
 			}
@@ -220,11 +492,11 @@ int Engine::PVS(int depth, int alpha, int beta)
 		if (score > alpha)
 		{
 			hashFlag = HASH_EXACT;
-			bestMove = *move;
+			bestMove = move;
 			alpha = score;
 
 			// Write move to triangular principle variation table
-			pvTable[ply][ply] = *move;
+			pvTable[ply][ply] = move;
 			// Loop over the next ply and copy the principle variation to the current ply
 			for (int nextPly = ply + 1; nextPly < pvLength[ply + 1]; nextPly ++)
 			{
@@ -237,16 +509,15 @@ int Engine::PVS(int depth, int alpha, int beta)
 			{
 				writeHashEntry(depth, bestMove, beta, HASH_BETA);
 
-				if (getCaptureFlag(*move) == 0)
+				if (getCaptureFlag(move) == 0)
 				{
 					killerMoves[ply][1] = killerMoves[ply][0];
-					killerMoves[ply][0] = *move;
-					historyMoves[getPiece(*move)][getEndSquare(*move)] += depth * depth;
+					killerMoves[ply][0] = move;
+					historyMoves[getPiece(move)][getEndSquare(move)] += depth * depth;
 				}
 				return beta;
 			}
 		}
-		move++;
 	}
 
 	// If player has no legal moves, it is either checkmate or stalemate
@@ -265,53 +536,49 @@ int Engine::PVS(int depth, int alpha, int beta)
 
 int Engine::quiescenceSearch(int alpha, int beta)
 {
-	if ((nodes & 2047) == 0)
+	if ((nodes.load(std::memory_order_relaxed) & 2047) == 0)
 	{
 		communicate();
 	}
 
-	nodes ++;
-	int evaluation = evaluate(game);
+	countNode();
+	int evaluation = staticEvaluation();
 
 	if (ply > MAX_PLY - 1) { return evaluation; }
 
-	if (evaluation >= beta)
+	// In check standing pat isn't an option, every evasion is searched instead
+	int isInCheck = (game.checkers != 0);
+
+	if (!isInCheck && evaluation >= beta)
 	{
 		return beta;
 	}
 
-	if (evaluation > alpha)
+	if (!isInCheck && evaluation > alpha)
 	{
 		alpha = evaluation;
 	}
 
-	game.generateAllMoves();
-	sortMoves(game.moveList, 0);
-
-	int *move = game.moveList;
+	// Only the captures are generated (or the evasions when in check)
+	MovePicker picker;
+	initMovePicker(picker, 0, ONLY_CAPTURES);
+	int move;
+	int legalMoves = 0;
 	
-	while (*move)
+	while ((move = pickNextMove(picker)) != 0)
 	{
-		if (getCaptureFlag(*move))
+		legalMoves ++;
+		// Delta pruning
+		if (!isInCheck && game.gamePhaseScore - MATERIAL_ABS[0][getCapturedPiece(move)] >= ENDGAME_PHASE_SCORE && 
+			(evaluation + MATERIAL_ABS[0][getCapturedPiece(move)] + 200 < alpha) && getPromotion(move) == NULL_PIECE)
 		{
-			// Delta pruning
-			if (game.gamePhaseScore - MATERIAL_ABS[0][getCapturedPiece(*move)] >= ENDGAME_PHASE_SCORE && 
-				(evaluation + MATERIAL_ABS[0][getCapturedPiece(*move)] + 200 < alpha) && getPromotion(*move) == NULL_PIECE)
-			{
-				move ++;
-				continue;
-			}
-			// Prune bad captures
-			if (badCapture(*move) && getPromotion(*move) == NULL_PIECE && MATERIAL_ABS[0][getCapturedPiece(*move)] != MATERIAL_ABS[0][getPiece(*move)])
-			{
-				move ++;
-				continue;				
-			}
+			continue;
 		}
-		else
+		// Prune captures that lose material
+		if (!isInCheck && getPromotion(move) == NULL_PIECE && MATERIAL_ABS[0][getCapturedPiece(move)] < MATERIAL_ABS[0][getPiece(move)] &&
+			staticExchangeEvaluation(move) < 0)
 		{
-			move ++;
-			continue;
+			continue;				
 		}
 
 		ply ++;
@@ -319,14 +586,8 @@ int Engine::quiescenceSearch(int alpha, int beta)
 		repetitionIndex ++;
 		repetitionTable[repetitionIndex] = game.hashKey;
 
-		GameState prevState = game.makeMove(*move, ONLY_CAPTURES);
-		if (!prevState.valid)
-		{
-			ply --;
-			repetitionIndex --;
-			move ++;
-			continue;
-		}
+		// The picker only returns legal moves
+		GameState prevState = game.makeMove(move, ALL_MOVES);
 		int score = -quiescenceSearch(-beta, -alpha);
 		game.takeBack(prevState);
 		ply --;
@@ -344,28 +605,85 @@ int Engine::quiescenceSearch(int alpha, int beta)
 			}
 		}
 
-		move++;
 	}
+	// Checkmated
+	if (isInCheck && legalMoves == 0) { return -MATE_VALUE + ply; }
+
 	return alpha;
 }
 
-int Engine::badCapture(int move)
+// Evaluate the position, skipping the evaluation if the position was already evaluated by any thread
+int Engine::staticEvaluation()
+{
+	std::atomic<uint64_t>& entry = evalCache[game.hashKey & (EVAL_CACHE_ENTRIES - 1)];
+	uint64_t data = entry.load(std::memory_order_relaxed);
+
+	evalCacheProbes.store(evalCacheProbes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if ((data & EVAL_CACHE_KEY_MASK) == (game.hashKey & EVAL_CACHE_KEY_MASK))
+	{
+		evalCacheHits.store(evalCacheHits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return (int16_t)(data & 0xffff);
+	}
+
+	int score = (NNUE::enabled ? NNUE::evaluate(game) : evaluate(game));
+	entry.store((game.hashKey & EVAL_CACHE_KEY_MASK) | (uint16_t)score, std::memory_order_relaxed);
+	return score;
+}
+
+// Static exchange evaluation: material won by the side to move when both sides keep capturing on the move's end square with their least valuable attacker
+int Engine::staticExchangeEvaluation(int move)
 {
+	int start = getStartSquare(move);
+	int end = getEndSquare(move);
 	int piece = getPiece(move);
-	int cap = getCapturedPiece(move);
+	int promotion = getPromotion(move);
+	int capturedPiece = getCapturedPiece(move);
+
+	if (getCastlingFlag(move)) { return 0; }
 
-	if (piece == P || piece == p) { return 0; }
+	int gain[32];
+	int depth = 0;
+	Bitboard occupancy = game.occupancies[ALL] ^ (1ull << start);
+	if (getEnpassantFlag(move)) { occupancy ^= 1ull << (piece == P ? end - 8 : end + 8); }
 
-	if (MATERIAL_ABS[0][cap] - MATERIAL_ABS[0][piece] >= -50) { return 0; }
+	gain[0] = (capturedPiece != NULL_PIECE ? MATERIAL_ABS[0][capturedPiece] : 0);
+	if (promotion != NULL_PIECE) { gain[0] += MATERIAL_ABS[0][promotion] - MATERIAL_ABS[0][P]; }
 
-	if (piece <= K)
+	// Piece that stands on the square and can be captured next
+	int target = (promotion != NULL_PIECE ? promotion : piece);
+	Bitboard diagonalSliders = game.bitboards[B] | game.bitboards[Q] | game.bitboards[b] | game.bitboards[q];
+	Bitboard straightSliders = game.bitboards[R] | game.bitboards[Q] | game.bitboards[r] | game.bitboards[q];
+	Bitboard attackers = (game.getAttackers(end, WHITE, occupancy) | game.getAttackers(end, BLACK, occupancy)) & occupancy;
+	int side = game.side ^ 1;
+
+	while (depth < 31)
 	{
-		if ((PAWN_ATTACKS[WHITE][getEndSquare(move)] & game.bitboards[p]) && (MATERIAL_ABS[0][cap] + 200 - MATERIAL_ABS[0][piece] < 0))
-		{
-			return 1;
-		}
-	}		
-	return 0;
+		Bitboard sideAttackers = attackers & game.occupancies[side];
+		if (!sideAttackers) { break; }
+
+		// Capture with the least valuable attacker
+		int attacker = (side == WHITE ? P : p);
+		while (!(sideAttackers & game.bitboards[attacker])) { attacker ++; }
+
+		depth ++;
+		gain[depth] = MATERIAL_ABS[0][target] - gain[depth - 1];
+
+		occupancy ^= 1ull << getLeastSignificantBitIndex(sideAttackers & game.bitboards[attacker]);
+		target = attacker;
+
+		// Sliders behind the capturing piece join in (x-rays)
+		attackers |= (generateBishopAttacks(end, occupancy) & diagonalSliders) | (generateRookAttacks(end, occupancy) & straightSliders);
+		attackers &= occupancy;
+		side ^= 1;
+	}
+
+	// Each side only continues the exchange when that is better than stopping
+	while (depth > 0)
+	{
+		gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+		depth --;
+	}
+	return gain[0];
 }
 
 int Engine::scoreMove(int move, int bestMove)
@@ -383,6 +701,11 @@ int Engine::scoreMove(int move, int bestMove)
 
 	if (getCaptureFlag(move))
 	{
+		// Captures that lose material go after the killers
+		if (MATERIAL_ABS[0][getCapturedPiece(move)] < MATERIAL_ABS[0][getPiece(move)] && staticExchangeEvaluation(move) < 0)
+		{
+			return MVV_LVA[getPiece(move)][getCapturedPiece(move)];
+		}
 		return MVV_LVA[getPiece(move)][getCapturedPiece(move)] + CAPTURE_SCORE;
 	}
 	else
@@ -404,47 +727,155 @@ int Engine::scoreMove(int move, int bestMove)
 	return -1;
 }
 
-void Engine::sortMoves(int * moveList, int bestMove)
+// Score every move of the list once, so that picking the moves doesn't score them again
+void Engine::scoreMoves(MoveList& moveList)
 {
-	int* move = moveList;
-	int* moveStart = move;
-	while(*move)
+	for (int i = 0; i < moveList.count; i++)
 	{
-		int* p = move;
-		int tmp = 0; 
-		while(p != moveStart)
-		{
-			if (scoreMove(*p, bestMove) > scoreMove(*(p-1), bestMove))
+		moveList.scores[i] = scoreMove(moveList.moves[i], 0);
+	}
+}
+
+// Move the best scored move from index on to index and return it (a selection sort step, nodes that cut off early never sort the whole list)
+int Engine::pickBestMove(MoveList& moveList, int index)
+{
+	int best = index;
+	for (int i = index + 1; i < moveList.count; i++)
+	{
+		if (moveList.scores[i] > moveList.scores[best]) { best = i; }
+	}
+
+	int move = moveList.moves[best];
+	int score = moveList.scores[best];
+	moveList.moves[best] = moveList.moves[index];
+	moveList.scores[best] = moveList.scores[index];
+	moveList.moves[index] = move;
+	moveList.scores[index] = score;
+	return move;
+}
+
+// Start picking the moves of the current ply, the hash move first
+void Engine::initMovePicker(MovePicker& picker, int hashMove, int moveType)
+{
+	picker.moveList = &moveLists[ply];
+	picker.moveType = moveType;
+	picker.stage = (moveType == ONLY_CAPTURES ? CAPTURE_GENERATION_STAGE : HASH_MOVE_STAGE);
+	if (game.checkers) { picker.stage = (moveType == ONLY_CAPTURES ? EVASION_GENERATION_STAGE : HASH_MOVE_STAGE); }
+	picker.index = 0;
+	picker.hashMove = hashMove;
+	picker.pvMove = 0;
+	picker.killers[0] = killerMoves[ply][0];
+	picker.killers[1] = killerMoves[ply][1];
+
+	// The principle variation move comes right after the hash move
+	if (scorePV && moveType == ALL_MOVES)
+	{
+		picker.pvMove = pvTable[0][ply];
+		scorePV = 0;
+	}
+}
+
+// Return the next move to search (0 if there are none left), generating the moves of a stage only once it is reached
+int Engine::pickNextMove(MovePicker& picker)
+{
+	MoveList& moveList = *picker.moveList;
+
+	switch (picker.stage)
+	{
+		case HASH_MOVE_STAGE:
+			picker.stage = PV_MOVE_STAGE;
+			if (game.isPseudoLegal(picker.hashMove) && game.isLegal(picker.hashMove)) { return picker.hashMove; }
+			picker.hashMove = 0;
+			// fall through
+
+		case PV_MOVE_STAGE:
+			picker.stage = (game.checkers ? EVASION_GENERATION_STAGE : CAPTURE_GENERATION_STAGE);
+			if (picker.pvMove != 0 && picker.pvMove != picker.hashMove) { return picker.pvMove; }
+			if (picker.stage == EVASION_GENERATION_STAGE) { return pickNextMove(picker); }
+			// fall through
+
+		case CAPTURE_GENERATION_STAGE:
+			game.generateAllMoves(moveList, ONLY_CAPTURES);
+			scoreMoves(moveList);
+			picker.index = 0;
+			picker.stage = CAPTURE_STAGE;
+			// fall through
+
+		case CAPTURE_STAGE:
+			while (picker.index < moveList.count)
 			{
-				tmp = *p;
-				*p = *(p-1);
-				*(p-1) = tmp;
-				p--;
+				int move = pickBestMove(moveList, picker.index ++);
+				if (move != picker.hashMove && move != picker.pvMove) { return move; }
 			}
-			else { break; }
-		}
-		move++;
+			if (picker.moveType == ONLY_CAPTURES) { picker.stage = DONE_STAGE; return 0; }
+			picker.index = 0;
+			picker.stage = KILLER_STAGE;
+			// fall through
+
+		case KILLER_STAGE:
+			// Killers are quiet moves that caused a cutoff in a sibling node, they might not even be possible here
+			while (picker.index < 2)
+			{
+				int move = picker.killers[picker.index ++];
+				if (move != 0 && move != picker.hashMove && move != picker.pvMove && getCaptureFlag(move) == 0 &&
+					!(picker.index == 2 && move == picker.killers[0]) && game.isPseudoLegal(move) && game.isLegal(move))
+				{
+					return move;
+				}
+			}
+			picker.stage = QUIET_GENERATION_STAGE;
+			// fall through
+
+		case QUIET_GENERATION_STAGE:
+			game.generateAllMoves(moveList, ONLY_QUIETS);
+			scoreMoves(moveList);
+			picker.index = 0;
+			picker.stage = QUIET_STAGE;
+			// fall through
+
+		case QUIET_STAGE:
+			while (picker.index < moveList.count)
+			{
+				int move = pickBestMove(moveList, picker.index ++);
+				if (move != picker.hashMove && move != picker.pvMove && move != picker.killers[0] && move != picker.killers[1]) { return move; }
+			}
+			picker.stage = DONE_STAGE;
+			return 0;
+
+		case EVASION_GENERATION_STAGE:
+			game.generateEvasions(moveList);
+			scoreMoves(moveList);
+			picker.index = 0;
+			picker.stage = EVASION_STAGE;
+			// fall through
+
+		case EVASION_STAGE:
+			while (picker.index < moveList.count)
+			{
+				int move = pickBestMove(moveList, picker.index ++);
+				if (move != picker.hashMove && move != picker.pvMove) { return move; }
+			}
+			picker.stage = DONE_STAGE;
+			// fall through
+
+		default:
+			return 0;
 	}
 }
 
 void Engine::enablePVScoring()
 {
 	inPV = 0;
-	int *move = game.moveList;
-	while (*move)
+	if (game.isPseudoLegal(pvTable[0][ply]) && game.isLegal(pvTable[0][ply]))
 	{
-		if (*move == pvTable[0][ply])
-		{
-			inPV = 1;
-			scorePV = 1;
-		}
-		move++;
+		inPV = 1;
+		scorePV = 1;
 	}
 }
 
-void Engine::resetEngine()
+void Engine::resetEngine(int clearHash)
 {
-	nodes = 0, ply = 0, bestEval = 0, inPV = 0, scorePV = 0, repetitionIndex = 0, duration = 0, knps = 0, stopped = 0;
+	nodes = 0, ply = 0, bestEval = 0, inPV = 0, scorePV = 0, repetitionIndex = 0, duration = 0, nps = 0, stopped = 0;
 
 	memset(killerMoves, 0, sizeof(killerMoves));
 	memset(historyMoves, 0, sizeof(historyMoves));
@@ -452,89 +883,303 @@ void Engine::resetEngine()
 	memset(pvTable, 0, sizeof(pvTable));
 	memset(repetitionTable, 0, sizeof(repetitionTable));
 
-	hashEntries = 0;
-	initTranspositionTable(64);
+	if (evalCache == NULL)
+	{
+		evalCache = new std::atomic<uint64_t>[EVAL_CACHE_ENTRIES];
+		for (int i = 0; i < EVAL_CACHE_ENTRIES; i ++) { evalCache[i].store(0, std::memory_order_relaxed); }
+	}
+	evalCacheProbes = 0, evalCacheHits = 0;
+
+	// Keep the table that is already allocated, a new game only needs to forget its contents (the first search allocates it)
+	// A shared table also holds the work of other engine processes, so it is never cleared
+	if (tt != NULL && clearHash && sharedHashName.empty()) { clearTranspositionTable(); }
 }
 
+// Zero the table with all search threads, clearing tens of gigabytes with a single thread takes ages
 void Engine::clearTranspositionTable()
 {
-	for (HashEntry* entry = tt; entry < tt + hashEntries; entry ++)
+	// Nothing to clear until the first search has allocated the table
+	if (tt == NULL) { return; }
+
+	std::vector<std::thread> threads;
+	uint64_t chunk = (hashBuckets + threadCount - 1) / threadCount;
+
+	for (int i = 0; i < threadCount; i ++)
 	{
-		entry -> hashKey = 0;
-		entry -> depth = 0;
-		entry -> flag = 0;
-		entry -> score = 0;
+		uint64_t start = chunk * i;
+		uint64_t end = (start + chunk < hashBuckets ? start + chunk : hashBuckets);
+		if (start >= end) { break; }
+		threads.push_back(std::thread([this, start, end]() { memset((void*)(tt + start), 0, (end - start) * sizeof(HashBucket)); }));
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
 	}
 }
 
-void Engine::initTranspositionTable(int mb)
+// Allocate the table through mmap so that it can be backed by huge pages, which stops TLB misses from dominating the probes
+static void* allocateHashMemory(uint64_t bytes, uint64_t& allocated)
+{
+	void* memory;
+	allocated = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+	// Explicit huge pages, only available if the administrator reserved them (vm.nr_hugepages)
+	memory = mmap(NULL, allocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (memory != MAP_FAILED) { return memory; }
+#endif
+
+	// Normal pages, with a hint to the kernel to back them with transparent huge pages
+	memory = mmap(NULL, allocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) { return NULL; }
+
+#ifdef MADV_HUGEPAGE
+	madvise(memory, allocated, MADV_HUGEPAGE);
+#endif
+
+	return memory;
+}
+
+// Attach to a named POSIX shared memory segment, so that every engine process on the host probes and stores into the same table.
+// The first process sizes the segment, the others have to ask for the same size (a segment is never resized, since that
+// would pull the pages from under the mappings of the processes already using it).
+static void* attachSharedHashMemory(string name, uint64_t bytes)
 {
-	int hashSize = 0x100000 * mb;
-	hashEntries = hashSize / sizeof(HashEntry);
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0) { return NULL; }
+
+	// Engines starting together could all see an empty segment, the lock lets exactly one of them size it
+	struct stat segmentStat;
+	if (flock(fd, LOCK_EX) != 0 || fstat(fd, &segmentStat) != 0 || (segmentStat.st_size == 0 && ftruncate(fd, bytes) != 0))
+	{
+		close(fd);
+		return NULL;
+	}
+	flock(fd, LOCK_UN);
+
+	if (segmentStat.st_size != 0 && (uint64_t)segmentStat.st_size != bytes)
+	{
+		cout << "info string shared hash " << name << " has " << segmentStat.st_size / 0x100000 << "Mb, not " << bytes / 0x100000 << "Mb" << endl;
+		close(fd);
+		return NULL;
+	}
+
+	void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) { return NULL; }
 
-	// Strange bug! Trying to free unallocated memory ? 
+#ifdef MADV_HUGEPAGE
+	madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+
+	return memory;
+}
+
+void Engine::freeTranspositionTable()
+{
 	if (tt != NULL)
 	{
-		// if (DEBUG_ENGINE) { cout << "Clearing hash memory ..." << endl; }
-		delete[] tt;
+		munmap(tt, hashBytes);
+	}
+	tt = NULL;
+	hashBuckets = 0;
+	hashBytes = 0;
+	hashShared = 0;
+}
+
+void Engine::initTranspositionTable(int mb)
+{
+	freeTranspositionTable();
+
+	if (!sharedHashName.empty())
+	{
+		uint64_t bytes = 0x100000ull * mb;
+		tt = (HashBucket*)attachSharedHashMemory(sharedHashName, bytes);
+		if (tt != NULL)
+		{
+			hashBytes = bytes;
+			hashMb = mb;
+			hashBuckets = bytes / sizeof(HashBucket);
+			// Every process would age the entries by its own searches and evict the fresh ones of the others, so a shared table
+			// isn't aged: all entries stay in generation 0 and are only replaced by depth
+			hashShared = 1;
+			hashGeneration = 0;
+			return;
+		}
+		// Couldn't attach, so fall back to a private table
 	}
 
-	tt = new HashEntry[hashEntries];
+	tt = (HashBucket*)allocateHashMemory(0x100000ull * mb, hashBytes);
 
-	if (tt == NULL)
+	if (tt == NULL && mb > 1)
 	{
 		// if (DEBUG_ENGINE) { cout << "Couldn't allocate memory to transposition table, try " << mb / 2 << " Mb ..." << endl; }
 		initTranspositionTable(mb / 2);
 	}
 
+	else if (tt == NULL)
+	{
+		// Not even 1 Mb, so search without a table rather than report one that doesn't exist (the probes skip it)
+		cout << "info string couldn't allocate the transposition table" << endl;
+		hashMb = 0;
+		hashBytes = 0;
+	}
+
 	else
 	{
-		clearTranspositionTable();
-		// if (DEBUG_ENGINE) { cout << "Transposition table initialized with " << hashEntries << " entries. (" << mb << ")" << endl; }		
+		// Anonymous mappings come zeroed from the kernel, so there is nothing to clear
+		hashMb = mb;
+		hashBuckets = 0x100000ull * mb / sizeof(HashBucket);
+		// if (DEBUG_ENGINE) { cout << "Transposition table initialized with " << hashBuckets << " buckets. (" << mb << ")" << endl; }		
+	}
+}
+
+// Write the table to a file so that a long analysis can be resumed after a restart
+int Engine::saveTranspositionTable(string path)
+{
+	if (tt == NULL) { return 0; }
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) { return 0; }
+
+	char header[HASH_FILE_HEADER_SIZE] = {0};
+	HashFileHeader* fileHeader = (HashFileHeader*)header;
+	memcpy(fileHeader -> magic, HASH_FILE_MAGIC, sizeof(HASH_FILE_MAGIC));
+	fileHeader -> version = HASH_FILE_VERSION;
+	fileHeader -> zobristSeed = ZOBRIST_SEED;
+	fileHeader -> bucketSize = sizeof(HashBucket);
+	fileHeader -> generation = hashGeneration;
+	fileHeader -> bucketCount = hashBuckets;
+
+	file.write(header, HASH_FILE_HEADER_SIZE);
+	file.write((const char*)tt, hashBuckets * sizeof(HashBucket));
+	return file.good() ? 1 : 0;
+}
+
+// Map a saved table in place of the current one. The mapping is private, so the search never writes back to the file
+int Engine::loadTranspositionTable(string path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return 0; }
+
+	HashFileHeader header;
+	struct stat fileStat;
+	if (read(fd, &header, sizeof(header)) != sizeof(header) || fstat(fd, &fileStat) != 0)
+	{
+		close(fd);
+		return 0;
 	}
+
+	// Entries saved with other keys or in another format would match the wrong positions
+	if (memcmp(header.magic, HASH_FILE_MAGIC, sizeof(HASH_FILE_MAGIC)) != 0 || header.version != HASH_FILE_VERSION || 
+		header.zobristSeed != ZOBRIST_SEED || header.bucketSize != sizeof(HashBucket) || header.bucketCount == 0 ||
+		(uint64_t)fileStat.st_size < HASH_FILE_HEADER_SIZE + header.bucketCount * sizeof(HashBucket))
+	{
+		close(fd);
+		return 0;
+	}
+
+	void* memory = mmap(NULL, header.bucketCount * sizeof(HashBucket), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, HASH_FILE_HEADER_SIZE);
+	close(fd);
+	if (memory == MAP_FAILED) { return 0; }
+
+	freeTranspositionTable();
+	tt = (HashBucket*)memory;
+	hashBuckets = header.bucketCount;
+	hashBytes = header.bucketCount * sizeof(HashBucket);
+	hashMb = hashBytes / 0x100000;
+	hashGeneration = header.generation;
+	return 1;
 }
 
 int Engine::readHashEntry(int depth, int alpha, int beta, int& bestMove)
 {
-	HashEntry *hashEntry = &tt[game.hashKey % hashEntries];
-	if ( hashEntry -> hashKey == game.hashKey )
+	if (tt == NULL) { return NO_HASH_ENTRY; }
+
+	HashBucket *bucket = &tt[getBucketIndex(game.hashKey, hashBuckets)];
+
+	for (HashEntry& entry : bucket -> entries)
 	{
-		if (hashEntry -> depth >= depth)
+		uint64_t data = entry.data.load(std::memory_order_relaxed);
+		uint64_t key = entry.key.load(std::memory_order_relaxed);
+
+		// A torn entry (key and data written by different threads) fails this check and is treated as a miss
+		if ((key ^ data) != game.hashKey) { continue; }
+
+		if (getHashDepth(data) >= depth)
 		{
-			int score = hashEntry -> score;
+			int score = getHashScore(data);
 			if (score < -MATE_SCORE) { score += ply; }
 			if (score > MATE_SCORE) { score -= ply; }
 
-			if (hashEntry -> flag == HASH_EXACT)
+			if (getHashFlag(data) == HASH_EXACT)
 			{
 				return score;
 			}
-			if (hashEntry -> flag == HASH_ALPHA && score <= alpha)
+			if (getHashFlag(data) == HASH_ALPHA && score <= alpha)
 			{
 				return alpha;				
 			}
-			if (hashEntry -> flag == HASH_ALPHA && score >= beta)
+			if (getHashFlag(data) == HASH_ALPHA && score >= beta)
 			{
 				return beta;
 			}
 		}
-		bestMove = hashEntry -> bestMove;
+		bestMove = getHashMove(data);
+		break;
 	}
 	return NO_HASH_ENTRY;
 }
 
 void Engine::writeHashEntry(int depth, int bestMove, int score, int flag)
 {
-	HashEntry *hashEntry = &tt[game.hashKey % hashEntries];
+	if (tt == NULL) { return; }
+
+	HashBucket *bucket = &tt[getBucketIndex(game.hashKey, hashBuckets)];
+	HashEntry *replace = NULL;
+	int replaceWorth = INF;
+
+	for (HashEntry& entry : bucket -> entries)
+	{
+		uint64_t data = entry.data.load(std::memory_order_relaxed);
+		uint64_t key = entry.key.load(std::memory_order_relaxed);
+
+		// Same position: overwrite it, unless it holds a deeper result of the current search
+		if ((key ^ data) == game.hashKey)
+		{
+			if (getHashGeneration(data) == hashGeneration && getHashDepth(data) > depth + 2 && flag != HASH_EXACT) { return; }
+			if (bestMove == 0) { bestMove = getHashMove(data); }
+			replace = &entry;
+			break;
+		}
+
+		// Otherwise replace the least valuable entry: empty ones first, then the ones that are 
+		// shallow or left over from earlier searches, and keep exact scores over bounds
+		int age = (hashGeneration - getHashGeneration(data) + HASH_GENERATIONS) % HASH_GENERATIONS;
+		int worth = (data == 0 ? -INF : getHashDepth(data) - 8 * age + (getHashFlag(data) == HASH_EXACT ? 2 : 0));
+		if (worth < replaceWorth)
+		{
+			replace = &entry;
+			replaceWorth = worth;
+		}
+	}
 
 	if (score < -MATE_SCORE) { score -= ply; }
 	if (score > MATE_SCORE) { score += ply; }
 
-	hashEntry -> score = score;
-	hashEntry -> depth = depth;
-	hashEntry -> flag = flag;
-	hashEntry -> hashKey = game.hashKey;
-	hashEntry -> bestMove = bestMove;
+	uint64_t data = encodeHashData(bestMove, score, depth, flag, hashGeneration);
+	replace -> key.store(game.hashKey ^ data, std::memory_order_relaxed);
+	replace -> data.store(data, std::memory_order_relaxed);
+}
+
+// Start loading the bucket of a child position as soon as its key is known, so that the probe one node later doesn't stall on memory
+void Engine::prefetchHashEntry(uint64_t hashKey)
+{
+#ifndef NO_PREFETCH
+	if (tt == NULL) { return; }
+	__builtin_prefetch(&tt[getBucketIndex(hashKey, hashBuckets)]);
+#endif
 }
 
 int Engine::isRepetition()
@@ -556,15 +1201,15 @@ void Engine::printResults(int currentDepth, int depth_limit, int debug)
 	{
 		if (bestEval > -MATE_VALUE && bestEval < -MATE_SCORE)
 		{
-			cout << "info score mate " << - (bestEval + MATE_VALUE) / 2 - 1 << " depth " << currentDepth << " time " << duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+			cout << "info score mate " << - (bestEval + MATE_VALUE) / 2 - 1 << " depth " << currentDepth << " time " << duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 		}
 		if (bestEval > MATE_SCORE && bestEval < MATE_VALUE)
 		{
-			cout << "info score mate " << (MATE_VALUE - bestEval) / 2 + 1 << " depth " << currentDepth << " time " << duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+			cout << "info score mate " << (MATE_VALUE - bestEval) / 2 + 1 << " depth " << currentDepth << " time " << duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 		}
 		else
 		{
-			cout << "info depth " << currentDepth << " score cp " << bestEval << " time " << (int)duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+			cout << "info depth " << currentDepth << " score cp " << bestEval << " time " << (int)duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 		}			
 		for (int i = 0; i < pvLength[0]; i ++)
 		{
@@ -602,15 +1247,15 @@ void Engine::printResults(int currentDepth, int depth_limit, int debug)
 		{
 			if (bestEval > -MATE_VALUE && bestEval < -MATE_SCORE)
 			{
-				cout << "info score mate " << - (bestEval + MATE_VALUE) / 2 - 1 << " depth " << currentDepth << " time " << duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+				cout << "info score mate " << - (bestEval + MATE_VALUE) / 2 - 1 << " depth " << currentDepth << " time " << duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 			}
 			if (bestEval > MATE_SCORE && bestEval < MATE_VALUE)
 			{
-				cout << "info score mate " << (MATE_VALUE - bestEval) / 2 + 1 << " depth " << currentDepth << " time " << duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+				cout << "info score mate " << (MATE_VALUE - bestEval) / 2 + 1 << " depth " << currentDepth << " time " << duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 			}
 			else
 			{
-				cout << "info depth " << currentDepth << " score cp " << bestEval << " time " << (int)duration << " nodes " << nodes << " nps " << knps * 1000 << " pv";
+				cout << "info depth " << currentDepth << " score cp " << bestEval << " time " << (int)duration << " nodes " << totalNodes() << " nps " << nps << " pv";
 			}						
 			for (int i = 0; i < pvLength[0]; i ++)
 			{
@@ -642,6 +1287,12 @@ void Engine::printResults(int currentDepth, int depth_limit, int debug)
 			cout << endl;
 		}
 	}
+
+	// Report how many static evaluations were found in the eval cache
+	if (debug || currentDepth == depth_limit)
+	{
+		cout << "info string eval cache hits " << evalCacheHitRate() << "%" << endl;
+	}
 }
 
 /*** UCI Section ***/
@@ -650,8 +1301,8 @@ void Engine::uciLoop()
 {
 	std::cin.clear();
 
-	int MAX_HASH = 128;
-	int mb = 64;
+	int mb = DEFAULT_HASH;
+	int threads = 1;
 
 	string input;
 	Game game;
@@ -665,6 +1316,8 @@ void Engine::uciLoop()
 
 		if (input.compare(0, 7, "isready", 7) == 0)
 		{
+			// Map the table now rather than on the first go, so a huge page fallback doesn't eat into the clock of the first move
+			if (tt == NULL) { this -> initTranspositionTable(hashMb); }
 			cout << "readyok" << endl;
 			continue;
 		}
@@ -687,7 +1340,10 @@ void Engine::uciLoop()
 		{
 			cout << "id name X" << endl;
 			cout << "id author Kai" << endl;
-			cout << "option name Hash type spin default 64 min 4 max " << MAX_HASH << endl;
+			cout << "option name Hash type spin default " << DEFAULT_HASH << " min 4 max " << MAX_HASH << endl;
+			cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << endl;
+			cout << "option name SharedHash type string default <empty>" << endl;
+			cout << "option name EvalFile type string default <empty>" << endl;
 			cout << "uciok" << endl;
 		}
 
@@ -703,6 +1359,44 @@ void Engine::uciLoop()
 			break;
 		}
 
+		// save the transposition table to a file
+		else if (input.compare(0, 8, "savehash", 8) == 0)
+		{
+			string path = input.substr(input.length() > 9 ? 9 : input.length());
+			if (this -> saveTranspositionTable(path)) { cout << "Saved hash to " << path << endl; }
+			else { cout << "Couldn't save hash to " << path << endl; }
+		}
+
+		// replace the transposition table with one saved before
+		else if (input.compare(0, 8, "loadhash", 8) == 0)
+		{
+			string path = input.substr(input.length() > 9 ? 9 : input.length());
+			if (this -> loadTranspositionTable(path)) { cout << "Loaded hash from " << path << " (" << hashMb << "Mb)" << endl; }
+			else { cout << "Couldn't load hash from " << path << endl; }
+		}
+
+		// time the slider attack look ups
+		else if (input.compare(0, 13, "bench sliders", 13) == 0)
+		{
+			this -> benchSliders();
+		}
+
+		// time the ordering of quiet move lists
+		else if (input.compare(0, 14, "bench ordering", 14) == 0)
+		{
+			this -> benchMoveOrdering();
+		}
+
+		// search the bench positions and report the speed
+		else if (input.compare(0, 5, "bench", 5) == 0)
+		{
+			// fall back to the default depth if there is no (valid) depth after the command
+			const char* depthString = input.c_str() + (input.length() > 6 ? 6 : input.length());
+			char* depthEnd;
+			long benchDepth = strtol(depthString, &depthEnd, 10);
+			this -> bench(depthEnd != depthString && benchDepth > 0 && benchDepth < MAX_PLY ? (int)benchDepth : BENCH_DEPTH);
+		}
+
 		// parse uci setoption command
 		else if (input.compare(0, 24, "setoption name Hash value", 24) == 0)
 		{
@@ -710,21 +1404,53 @@ void Engine::uciLoop()
             // adjust MB if going beyond the aloowed bounds
             if(mb < 4) mb = 4;
             if(mb > MAX_HASH) mb = MAX_HASH;
+            // the table may come out smaller than asked for, so report the size actually mapped
             this -> initTranspositionTable(mb);
-            cout << "Set hash size to " << mb << "Mb" << endl;
-		}		
+            cout << "Set hash size to " << hashMb << "Mb" << endl;
+		}
+		// parse uci setoption command (name of a shared memory segment holding the hash, empty for a private one)
+		else if (input.compare(0, 25, "setoption name SharedHash", 25) == 0)
+		{
+			sharedHashName = (input.length() > 32 ? input.substr(32) : "");
+			if (sharedHashName == "<empty>") { sharedHashName = ""; }
+			if (!sharedHashName.empty() && sharedHashName[0] != '/') { sharedHashName = "/" + sharedHashName; }
+			this -> initTranspositionTable(mb);
+			cout << "Set shared hash to " << (sharedHashName.empty() ? "<none>" : sharedHashName) << " (" << hashMb << "Mb)" << endl;
+		}
+		// parse uci setoption command (network file of the NNUE evaluation, empty for the hand-written evaluation)
+		else if (input.compare(0, 23, "setoption name EvalFile", 23) == 0)
+		{
+			std::string evalFile = (input.length() > 30 ? input.substr(30) : "");
+			if (evalFile.empty() || evalFile == "<empty>") { NNUE::unload(); }
+			else { NNUE::load(evalFile); }
+
+			// Cached scores came from the other evaluation
+			for (int i = 0; evalCache != NULL && i < EVAL_CACHE_ENTRIES; i ++) { evalCache[i].store(0, std::memory_order_relaxed); }
+			cout << "Set evaluation to " << (NNUE::enabled ? evalFile : "hand-written") << endl;
+		}
+		// parse uci setoption command
+		else if (input.compare(0, 28, "setoption name Threads value", 28) == 0)
+		{
+			threads = stoi(input.substr(29, input.length() - 1));
+			// adjust the thread count if going beyond the allowed bounds
+			if (threads < 1) threads = 1;
+			if (threads > MAX_THREADS) threads = MAX_THREADS;
+			this -> setThreads(threads);
+			cout << "Set thread count to " << threads << endl;
+		}
 	}
 }
 
 // Parse user/GUI move command (e.g. e7e8q)
 int Engine::parseMove(Game& game, string moveString)
 {
-	game.generateAllMoves();
+	MoveList moveList;
+	game.generateAllMoves(moveList);
 	int startSquare = (moveString[0] - 'a')	+ 8 * (atoi(&moveString[1]) - 1);
 	int endSquare = (moveString[2] - 'a') + 8 * (atoi(&moveString[3]) - 1);
-	int* move = game.moveList;
+	int* move = moveList.moves;
 
-	while (*move)
+	while (move != moveList.moves + moveList.count)
 	{
 		if (getStartSquare(*move) == startSquare && getEndSquare(*move) == endSquare)
 		{
@@ -807,7 +1533,8 @@ void Engine::Engine::parsePosition(Game& game, string command)
 		}
 		else
 		{
-			this -> resetEngine();
+			// Setting up a position keeps the hash, so a saved or previous analysis can be continued
+			this -> resetEngine(0);
 		}
 	}
 	else
@@ -869,7 +1596,8 @@ void Engine::Engine::parsePosition(Game& game, string command)
 			}
 			else
 			{
-				this -> resetEngine();
+				// Setting up a position keeps the hash, so a saved or previous analysis can be continued
+				this -> resetEngine(0);
 			}			
 		}
 	}
@@ -1061,12 +1789,18 @@ void Engine::readInput()
 
 // a bridge function to interact between search and GUI input
 void Engine::communicate() {
+	// Helper threads never talk to the GUI, they just follow the main thread
+	if (threadId != 0)
+	{
+		if (mainThread -> stopped == 1) { stopped = 1; }
+		return;
+	}
 	// if time is up break here
     if(timeset == 1 && getTimems() > stoptime) {
     	if (DEBUG_ENGINE && stopped != 1) { cout << "times up!" << endl; }
 		// tell engine to stop calculating
 		stopped = 1;
 	}
-    // read GUI input
-	readInput();
+    // read GUI input (nobody is talking to the bench, so don't let stdin interrupt it)
+	if (!benchmarking) { readInput(); }
 };
@@ -1,6 +1,10 @@
 #ifndef ENGINE_H
 #define ENGINE_H
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 const std::string VERSION = "1.0";
 
 // Used for negamx and alpha beta pruning
@@ -48,30 +52,122 @@ const int NULL_MOVE_REDUCTION = 2;
 // 
 const int ASPIRATION_WINDOW_SIZE = 50;
 
+// Lazy SMP
+const int MAX_THREADS = 128;
+
+// Positions searched by the bench command
+const int BENCH_DEPTH = 8;
+const int BENCH_POSITION_COUNT = 8;
+// Occupancies and rounds over them timed by bench sliders
+const int SLIDER_BENCH_OCCUPANCIES = 4096;
+const int SLIDER_BENCH_ROUNDS = 5000;
+// Random games played from each bench position, their length and rounds over the move lists timed by bench ordering
+const int ORDERING_BENCH_GAMES = 50;
+const int ORDERING_BENCH_PLIES = 40;
+const int ORDERING_BENCH_ROUNDS = 50;
+const std::string BENCH_POSITIONS[BENCH_POSITION_COUNT] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"r2q1rk1/ppp2ppp/2n1bn2/2b1p3/3pP3/3P1NPP/PPP1NPB1/R1BQ1RK1 b - - 0 9",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1"
+};
+
 // Transposition table
 const int HASH_EXACT = 0;
 const int HASH_ALPHA = 1;
 const int HASH_BETA = 2;
 const int HASH_SIZE = 0x100000;
+const int DEFAULT_HASH = 64;
+const int MAX_HASH = 131072;
+const uint64_t HUGE_PAGE_SIZE = 0x200000;
 const int NO_HASH_ENTRY = 100000;
+const int HASH_BUCKET_SIZE = 4;
+const int HASH_GENERATIONS = 64;
 
+// Lockless hash entry: the key is stored xor-ed with the data, so an entry torn by 
+// two threads writing at the same time no longer matches any position and reads as a miss
 struct HashEntry
 {
-	uint64_t hashKey;
-	int depth;
-	int flag;
-	int score;
-	int bestMove;
+	std::atomic<uint64_t> key;
+	std::atomic<uint64_t> data;
+};
+
+// Entries are grouped in cache line sized buckets, so a probe costs at most one cache miss
+struct alignas(64) HashBucket
+{
+	HashEntry entries[HASH_BUCKET_SIZE];
+};
+
+// Static evaluation cache, each entry packs the upper 48 bits of the hash key with a 16 bit score into one atomic word
+const int EVAL_CACHE_ENTRIES = 0x40000;
+const uint64_t EVAL_CACHE_KEY_MASK = ~0xffffull;
+
+// Header of transposition table snapshot files, padded to a page so the buckets behind it can be mapped directly
+const char HASH_FILE_MAGIC[8] = "XHASH";
+const uint32_t HASH_FILE_VERSION = 2;
+const int HASH_FILE_HEADER_SIZE = 4096;
+
+struct HashFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t zobristSeed;
+	uint32_t bucketSize;
+	uint32_t generation;
+	uint64_t bucketCount;
+};
+
+// Map a hash key to a bucket with a multiply and a shift instead of a 64 bit modulo
+static inline uint64_t getBucketIndex(uint64_t hashKey, uint64_t bucketCount)
+{
+	return (uint64_t)(((unsigned __int128)hashKey * bucketCount) >> 64);
+}
+
+// Hash entry data encoding (best move: 28 bits, score: 20 bits, depth: 8 bits, flag: 2 bits, generation: 6 bits)
+const int HASH_SCORE_OFFSET = 0x80000;
+
+static inline uint64_t encodeHashData(int bestMove, int score, int depth, int flag, int generation)
+{
+	return (uint64_t)(bestMove & 0xfffffff) | ((uint64_t)(score + HASH_SCORE_OFFSET) << 28) | ((uint64_t)(depth & 0xff) << 48) | ((uint64_t)flag << 56) | ((uint64_t)generation << 58);
+}
+
+// Hash entry data decoding
+static inline int getHashMove (uint64_t data) { return data & 0xfffffff; }
+static inline int getHashScore (uint64_t data) { return (int)((data >> 28) & 0xfffff) - HASH_SCORE_OFFSET; }
+static inline int getHashDepth (uint64_t data) { return (data >> 48) & 0xff; }
+static inline int getHashFlag (uint64_t data) { return (data >> 56) & 0x3; }
+static inline int getHashGeneration (uint64_t data) { return (data >> 58) & 0x3f; }
+
+// Move picker stages, each one only generates its moves when the ones before it are used up (in check all evasions are generated at once)
+enum PickerStage {
+	HASH_MOVE_STAGE, PV_MOVE_STAGE, CAPTURE_GENERATION_STAGE, CAPTURE_STAGE, KILLER_STAGE, QUIET_GENERATION_STAGE, QUIET_STAGE,
+	EVASION_GENERATION_STAGE, EVASION_STAGE, DONE_STAGE
+};
+
+struct MovePicker
+{
+	MoveList * moveList;
+	int moveType;
+	int stage;
+	int index;
+	int hashMove;
+	int pvMove;
+	int killers[2];
 };
 
 class Engine
 {
 public:
 	Game game;
-	int nodes;
+	// Nodes searched by this thread (only written by it, read by the main thread for the totals)
+	std::atomic<uint64_t> nodes;
 	int ply;
 	int duration;
-	int knps;
+	uint64_t nps;
 	int bestEval;
 	int inPV;
 	int scorePV;
@@ -79,24 +175,58 @@ public:
 	int historyMoves[12][64];
 	int pvLength[MAX_PLY];
 	int pvTable[MAX_PLY][MAX_PLY];
-	int hashEntries;
-	HashEntry * tt = NULL;
+	MoveList moveLists[MAX_PLY];
+	uint64_t hashBuckets = 0;
+	uint64_t hashBytes = 0;
+	// Whether the table is a shared memory segment (which isn't aged, see initTranspositionTable)
+	int hashShared = 0;
+	int hashMb = DEFAULT_HASH;
+	std::string sharedHashName;
+	int hashGeneration = 0;
+	HashBucket * tt = NULL;
+	std::atomic<uint64_t> * evalCache = NULL;
+	// Eval cache probes and hits of this thread (only written by it, read by the main thread like nodes)
+	std::atomic<uint64_t> evalCacheProbes;
+	std::atomic<uint64_t> evalCacheHits;
 	int repetitionTable[1000];
 	int repetitionIndex;
 
+	// Lazy SMP helper threads, each searching on its own copy of the game while sharing the transposition table
+	int threadId = 0;
+	int threadCount = 1;
+	Engine * mainThread = this;
+	std::vector<std::unique_ptr<Engine>> helpers;
+
 	Engine();
-	void search(Game curerntGame, int depth);
+	Engine(Engine * main, int id);
+	void setThreads(int count);
+	uint64_t totalNodes();
+	// Count a node (a plain load and store, the thread is the only writer)
+	inline void countNode() { nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+	int evalCacheHitRate();
+	void search(const Game& curerntGame, int depth);
+	void bench(int depth);
+	void benchSliders();
+	void benchMoveOrdering();
 	int PVS(int depth, int alpha, int beta);
 	int quiescenceSearch(int alpha, int beta);	
-	int badCapture(int move);
+	int staticEvaluation();
+	int staticExchangeEvaluation(int move);
 	int scoreMove(int move, int bestMove);
-	void sortMoves(int * moveList, int bestMove);
+	void scoreMoves(MoveList& moveList);
+	int pickBestMove(MoveList& moveList, int index);
 	void enablePVScoring();
-	void resetEngine();
+	void initMovePicker(MovePicker& picker, int hashMove, int moveType);
+	int pickNextMove(MovePicker& picker);
+	void resetEngine(int clearHash = 1);
 	void clearTranspositionTable();
 	void initTranspositionTable(int mb);
+	void freeTranspositionTable();
+	int saveTranspositionTable(std::string path);
+	int loadTranspositionTable(std::string path);
 	int readHashEntry(int depth, int alpha, int beta, int& bestMove);
 	void writeHashEntry(int depth, int bestMove, int score, int flag);
+	void prefetchHashEntry(uint64_t hashKey);
 	int isRepetition();
 	void printResults(int currentDepth, int depth_limit, int fullResults);	
 
@@ -110,7 +240,8 @@ public:
 	int starttime = 0;
 	int stoptime = 0;
 	int timeset = 0;
-	int stopped = 0;
+	int benchmarking = 0;
+	std::atomic<int> stopped{0};
 
 	void uciLoop();
 	int parseMove(Game& game, std::string moveString);
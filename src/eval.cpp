@@ -1,22 +1,18 @@
+#include <algorithm>
+#include <cstdlib>
+
 #include "utils.h"
 #include "masks.h"
 #include "movegen.h"
 #include "eval.h"
 
-Bitboard FILE_MASKS[64];
-Bitboard RANK_MASKS[64];
-Bitboard ISOLATED_MASKS[64];
-Bitboard WHITE_PASS_MASKS[64];
-Bitboard BLACK_PASS_MASKS[64];
+// Every search thread gets its own pawn hash table, so no locking is needed
+thread_local PawnHashEntry PAWN_HASH_TABLE[PAWN_HASH_ENTRIES];
+thread_local MaterialHashEntry MATERIAL_HASH_TABLE[MATERIAL_HASH_ENTRIES];
 
 void Evaluation::init()
 {
-	// Initilize masks that help determine pawn structures, king safety and piece mobility
-	generateFileMasks();
-	generateRankMasks();
-	generateIsolatedMasks();
-	generatePassMasks();
-
+	// Masks and piece square scores are generated at compile time (see the end of this file)
 	if (DEBUG_EVAL)
 	{
 		// printDebug();
@@ -24,90 +20,64 @@ void Evaluation::init()
 }
 
 // Give a static evaluation of the position by assessing material, piece placement, pawn structures, king safety, and piece mobility
-int evaluate(Game game)
+int evaluate(const Game& game)
 {
 	int score;
 	int gamePhase = -1;
-	int openingScore = 0;
-	int endgameScore = 0;
 
-	if (game.gamePhaseScore > OPENING_PHASE_SCORE) { gamePhase = OPENING; }
-	else if (game.gamePhaseScore < ENDGAME_PHASE_SCORE) { gamePhase = ENDGAME; }
+	// Material and positional scores are kept up to date by the game
+	int openingScore = game.openingScore;
+	int endgameScore = game.endgameScore;
+
+	// Drawn and basic won endgames are handled by their own evaluators
+	MaterialHashEntry* materialEntry = probeMaterialHashTable(game);
+	if (materialEntry -> evaluator != NULL)
+	{
+		return materialEntry -> evaluator(game, materialEntry -> strongSide);
+	}
+
+	int gamePhaseScore = materialEntry -> gamePhaseScore;
+
+	if (gamePhaseScore > OPENING_PHASE_SCORE) { gamePhase = OPENING; }
+	else if (gamePhaseScore < ENDGAME_PHASE_SCORE) { gamePhase = ENDGAME; }
 	else { gamePhase = MIDDLEGAME; }
 
 	int square;
 
 	for (int piece = P; piece <= k; piece++)
 	{
+		// Pawns, queens and kings have no other piece terms
+		if (piece == P || piece == Q || piece == K || piece == p || piece == q || piece == k) { continue; }
+
 		Bitboard bb = game.bitboards[piece];
 		while (bb)
 		{
 			square = getLeastSignificantBitIndex(bb);
 
-			// Add material placement score
-			openingScore += MATERIAL[OPENING][piece];
-			endgameScore += MATERIAL[ENDGAME][piece];
-
 			switch (piece)
 			{
-				case P:
-					openingScore += POSITIONAL_SCORE[OPENING][PAWN][MIRROR[square]];
-					endgameScore += POSITIONAL_SCORE[ENDGAME][PAWN][MIRROR[square]];
-
-					// Punish doubled pawns
-					endgameScore -= DOUBLE_PAWN_PENALTY * countBits(game.bitboards[P] & FILE_MASKS[square]);
-					// Punish isolated pawns
-					endgameScore -= ISOLATED_PAWN_PENALTY * (((game.bitboards[P] & ISOLATED_MASKS[square]) == 0) ? 1 : 0);
-					// Give bonus score to pass pawns
-					endgameScore += POSITIONAL_SCORE[ENDGAME][PAWN][MIRROR[square]] / 2 * (((WHITE_PASS_MASKS[square] & game.bitboards[p]) == 0) ? 1 : 0);
-
-					break;
-
-				case p:
-					openingScore -= POSITIONAL_SCORE[OPENING][PAWN][square];
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][PAWN][square];
-
-					// Punish doubled pawns
-					endgameScore += DOUBLE_PAWN_PENALTY * countBits(game.bitboards[p] & FILE_MASKS[square]);
-					// Punish isolated pawns
-					endgameScore += ISOLATED_PAWN_PENALTY * (((game.bitboards[p] & ISOLATED_MASKS[square]) == 0) ? 1 : 0);
-					// Give bonus score to pass pawns
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][PAWN][square] / 2 * (((BLACK_PASS_MASKS[square] & game.bitboards[P]) == 0) ? 1 : 0);
-
-					break;
-
 				case N:
-					openingScore += POSITIONAL_SCORE[OPENING][KNIGHT][MIRROR[square]];
 					openingScore += getKnightMobilityScore(countBits(KNIGHT_ATTACKS[square]));
-					endgameScore += POSITIONAL_SCORE[ENDGAME][KNIGHT][MIRROR[square]];
 					endgameScore += getKnightMobilityScore(countBits(KNIGHT_ATTACKS[square]));
 					break;
 
 				case n:
-					openingScore -= POSITIONAL_SCORE[OPENING][KNIGHT][square];
 					openingScore -= getKnightMobilityScore(countBits(KNIGHT_ATTACKS[square]));
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][KNIGHT][square];
 					endgameScore -= getKnightMobilityScore(countBits(KNIGHT_ATTACKS[square]));
 					break;
 
 				case B:
-					openingScore += POSITIONAL_SCORE[OPENING][BISHOP][MIRROR[square]];
 					openingScore += getBishopMobilityScore(countBits(generateBishopAttacks(square, game.bitboards[ALL])));
-					endgameScore += POSITIONAL_SCORE[ENDGAME][BISHOP][MIRROR[square]];
 					endgameScore += getBishopMobilityScore(countBits(generateBishopAttacks(square, game.bitboards[ALL])));
 					break;
 
 				case b:
-					openingScore -= POSITIONAL_SCORE[OPENING][BISHOP][square];
 					openingScore -= getBishopMobilityScore(countBits(generateBishopAttacks(square, game.bitboards[ALL])));
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][BISHOP][square];
 					endgameScore -= getBishopMobilityScore(countBits(generateBishopAttacks(square, game.bitboards[ALL])));
 					break;
 
 				case R:
-					openingScore += POSITIONAL_SCORE[OPENING][ROOK][MIRROR[square]];
 					openingScore += getRookMobilityScore(OPENING, countBits(generateRookAttacks(square, game.bitboards[ALL])));
-					endgameScore += POSITIONAL_SCORE[ENDGAME][ROOK][MIRROR[square]];
 					endgameScore += getRookMobilityScore(ENDGAME, countBits(generateRookAttacks(square, game.bitboards[ALL])));
 
 					// Give bonus score to rooks on (semi) open files			
@@ -117,9 +87,7 @@ int evaluate(Game game)
 					break;
 
 				case r:
-					openingScore -= POSITIONAL_SCORE[OPENING][ROOK][square];
 					openingScore -= getRookMobilityScore(OPENING, countBits(generateRookAttacks(square, game.bitboards[ALL])));
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][ROOK][square];
 					endgameScore -= getRookMobilityScore(ENDGAME, countBits(generateRookAttacks(square, game.bitboards[ALL])));
 
 					// Give bonus score to rooks on (semi) open files			
@@ -128,49 +96,19 @@ int evaluate(Game game)
 
 					break;
 
-				case Q:
-					openingScore += POSITIONAL_SCORE[OPENING][QUEEN][MIRROR[square]];
-					endgameScore += POSITIONAL_SCORE[ENDGAME][QUEEN][MIRROR[square]];
-					break;
-
-				case q:
-					openingScore -= POSITIONAL_SCORE[OPENING][QUEEN][square];
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][QUEEN][square];
-					break;	
-
-				case K:
-					openingScore += POSITIONAL_SCORE[OPENING][KING][MIRROR[square]];
-					endgameScore += POSITIONAL_SCORE[ENDGAME][KING][MIRROR[square]];
-
-					// Punish the king on (semi) open files			
-					openingScore -= OPEN_FILE_SCORE * ((((game.bitboards[P] | game.bitboards[p]) & FILE_MASKS[square]) == 0) ? 1 : 0);
-					openingScore -= SEMI_OPEN_FILE_SCORE * (((game.bitboards[P] & FILE_MASKS[square]) == 0) ? 1 : 0);
-					// Give bonus score to the king with a pawn shield
-					openingScore += PAWN_SHIELD_SCORE * countBits((KING_ATTACKS[square] & game.bitboards[P]) & ~(FILE_D_MASK | FILE_E_MASK));
-
-					break;
-
-				case k:
-					openingScore -= POSITIONAL_SCORE[OPENING][KING][square];
-					endgameScore -= POSITIONAL_SCORE[ENDGAME][KING][square];
-
-					// Punish the king on (semi) open files			
-					openingScore += OPEN_FILE_SCORE * ((((game.bitboards[P] | game.bitboards[p]) & FILE_MASKS[square]) == 0) ? 1 : 0);
-					openingScore += SEMI_OPEN_FILE_SCORE * (((game.bitboards[p] & FILE_MASKS[square]) == 0) ? 1 : 0);
-					// Give bonus score to the king with a pawn shield
-					openingScore -= PAWN_SHIELD_SCORE * countBits((KING_ATTACKS[square] & game.bitboards[p]) & ~(FILE_D_MASK | FILE_E_MASK));
-
-					break;	
-
 				default:
-					if (DEBUG_EVAL) { std::cout << "Eval Err! Piece: " << piece << std::endl; }
-					return 0;							
+					break;
 			}
 			// Remove bit
 			bb = popBit(bb, square);
 		}
 	}
 
+	// Pawn structure and king shelter are looked up in the pawn hash table
+	PawnHashEntry* pawnEntry = probePawnHashTable(game);
+	openingScore += pawnEntry -> openingScore + pawnEntry -> kingShelter[WHITE] + pawnEntry -> kingShelter[BLACK];
+	endgameScore += pawnEntry -> endgameScore;
+
 	if (gamePhase == OPENING)
 	{
 		score = openingScore;
@@ -182,14 +120,282 @@ int evaluate(Game game)
 	// Interpolated score
 	else
 	{
-		score = (openingScore * game.gamePhaseScore + endgameScore * (OPENING_PHASE_SCORE - game.gamePhaseScore)) / OPENING_PHASE_SCORE;
+		score = (openingScore * gamePhaseScore + endgameScore * (OPENING_PHASE_SCORE - gamePhaseScore)) / OPENING_PHASE_SCORE;
 	}
 
+	// Scale down the score of a side that is ahead without the material to win
+	score = score * materialEntry -> scaleFactor[(score > 0) ? WHITE : BLACK] / SCALE_FACTOR_NORMAL;
+
 	// // Return minus score for black to make sure that every player tries to maximize their scores
 	return (game.side == WHITE) ? score : -score;
 }
 
-int getGamePhaseScore(Game game)
+// Look up the pawn structure of the position, evaluating it only if it isn't in the table yet
+PawnHashEntry* probePawnHashTable(const Game& game)
+{
+	PawnHashEntry* entry = &PAWN_HASH_TABLE[game.pawnKey & (PAWN_HASH_ENTRIES - 1)];
+	int whiteKing = getLeastSignificantBitIndex(game.bitboards[K]);
+	int blackKing = getLeastSignificantBitIndex(game.bitboards[k]);
+
+	if (entry -> pawnKey != game.pawnKey)
+	{
+		entry -> pawnKey = game.pawnKey;
+		evaluatePawnStructure(game, entry);
+		entry -> kingSquare[WHITE] = SQ_NONE;
+		entry -> kingSquare[BLACK] = SQ_NONE;
+	}
+
+	// The shelter also depends on where the king stands, so it's only reused while the king stays put
+	if (entry -> kingSquare[WHITE] != whiteKing)
+	{
+		entry -> kingSquare[WHITE] = whiteKing;
+		entry -> kingShelter[WHITE] = evaluateKingShelter(game, WHITE, whiteKing);
+	}
+	if (entry -> kingSquare[BLACK] != blackKing)
+	{
+		entry -> kingSquare[BLACK] = blackKing;
+		entry -> kingShelter[BLACK] = evaluateKingShelter(game, BLACK, blackKing);
+	}
+
+	return entry;
+}
+
+// Score doubled, isolated and passed pawns
+void evaluatePawnStructure(const Game& game, PawnHashEntry* entry)
+{
+	int square;
+	entry -> openingScore = 0;
+	entry -> endgameScore = 0;
+
+	Bitboard bb = game.bitboards[P];
+	while (bb)
+	{
+		square = getLeastSignificantBitIndex(bb);
+		// Punish doubled pawns
+		entry -> endgameScore -= DOUBLE_PAWN_PENALTY * countBits(game.bitboards[P] & FILE_MASKS[square]);
+		// Punish isolated pawns
+		entry -> endgameScore -= ISOLATED_PAWN_PENALTY * (((game.bitboards[P] & ISOLATED_MASKS[square]) == 0) ? 1 : 0);
+		// Give bonus score to pass pawns
+		entry -> endgameScore += POSITIONAL_SCORE[ENDGAME][PAWN][MIRROR[square]] / 2 * (((WHITE_PASS_MASKS[square] & game.bitboards[p]) == 0) ? 1 : 0);
+		bb = popBit(bb, square);
+	}
+
+	bb = game.bitboards[p];
+	while (bb)
+	{
+		square = getLeastSignificantBitIndex(bb);
+		// Punish doubled pawns
+		entry -> endgameScore += DOUBLE_PAWN_PENALTY * countBits(game.bitboards[p] & FILE_MASKS[square]);
+		// Punish isolated pawns
+		entry -> endgameScore += ISOLATED_PAWN_PENALTY * (((game.bitboards[p] & ISOLATED_MASKS[square]) == 0) ? 1 : 0);
+		// Give bonus score to pass pawns
+		entry -> endgameScore -= POSITIONAL_SCORE[ENDGAME][PAWN][square] / 2 * (((BLACK_PASS_MASKS[square] & game.bitboards[P]) == 0) ? 1 : 0);
+		bb = popBit(bb, square);
+	}
+}
+
+// Score the pawns in front of the king and the (semi) open file it stands on (opening score only)
+int evaluateKingShelter(const Game& game, int color, int square)
+{
+	int score = 0;
+	Bitboard ownPawns = (color == WHITE ? game.bitboards[P] : game.bitboards[p]);
+
+	// Punish the king on (semi) open files			
+	score -= OPEN_FILE_SCORE * ((((game.bitboards[P] | game.bitboards[p]) & FILE_MASKS[square]) == 0) ? 1 : 0);
+	score -= SEMI_OPEN_FILE_SCORE * (((ownPawns & FILE_MASKS[square]) == 0) ? 1 : 0);
+	// Give bonus score to the king with a pawn shield
+	score += PAWN_SHIELD_SCORE * countBits((KING_ATTACKS[square] & ownPawns) & ~(FILE_D_MASK | FILE_E_MASK));
+
+	return (color == WHITE ? score : -score);
+}
+
+// Look up the material balance of the position, analysing it only if it isn't in the table yet
+MaterialHashEntry* probeMaterialHashTable(const Game& game)
+{
+	MaterialHashEntry* entry = &MATERIAL_HASH_TABLE[game.materialKey & (MATERIAL_HASH_ENTRIES - 1)];
+
+	if (entry -> materialKey != game.materialKey)
+	{
+		entry -> materialKey = game.materialKey;
+		evaluateMaterial(game, entry);
+	}
+
+	return entry;
+}
+
+// Work out the game phase, the scale factors and whether a specialized evaluator knows the endgame better
+void evaluateMaterial(const Game& game, MaterialHashEntry* entry)
+{
+	int count[12];
+	for (int piece = P; piece <= k; piece ++)
+	{
+		count[piece] = countBits(game.bitboards[piece]);
+	}
+
+	// Material without pawns and kings
+	int pieceMaterial[2] = {0, 0};
+	for (int piece = N; piece <= Q; piece ++)
+	{
+		pieceMaterial[WHITE] += count[piece] * MATERIAL_ABS[OPENING][piece];
+		pieceMaterial[BLACK] += count[piece + 6] * MATERIAL_ABS[OPENING][piece + 6];
+	}
+
+	entry -> gamePhaseScore = pieceMaterial[WHITE] + pieceMaterial[BLACK];
+	entry -> scaleFactor[WHITE] = SCALE_FACTOR_NORMAL;
+	entry -> scaleFactor[BLACK] = SCALE_FACTOR_NORMAL;
+	entry -> drawn = 0;
+	entry -> strongSide = WHITE;
+	entry -> evaluator = NULL;
+
+	// Kings alone or with a single minor piece left can never mate
+	int minors = count[N] + count[B] + count[n] + count[b];
+	if (count[P] + count[p] + count[R] + count[r] + count[Q] + count[q] == 0 && minors <= 1)
+	{
+		entry -> drawn = 1;
+		entry -> evaluator = evaluateDraw;
+		return;
+	}
+
+	for (int color = BLACK; color <= WHITE; color ++)
+	{
+		int offset = (color == WHITE ? 0 : 6);
+		int weakOffset = (color == WHITE ? 6 : 0);
+
+		// Basic mates against a lone king
+		if (pieceMaterial[color ^ 1] == 0 && count[P + weakOffset] == 0)
+		{
+			if (count[P + offset] == 0 && count[N + offset] == 1 && count[B + offset] == 1 && count[R + offset] == 0 && count[Q + offset] == 0)
+			{
+				entry -> strongSide = color;
+				entry -> evaluator = evaluateKBNK;
+				return;
+			}
+			// Two knights can't force mate. The position isn't marked drawn like the ones above, since the weak side can still 
+			// walk into a mate and the search should find it, but the static score is scaled down to a draw
+			if (count[P + offset] == 0 && count[N + offset] == 2 && count[B + offset] + count[R + offset] + count[Q + offset] == 0)
+			{
+				entry -> scaleFactor[color] = 0;
+				return;
+			}
+			// Bishops can only mate if there is one on each colour, which the material key doesn't tell apart
+			if (count[B + offset] >= 2 && count[N + offset] + count[R + offset] + count[Q + offset] == 0)
+			{
+				entry -> strongSide = color;
+				entry -> evaluator = evaluateKBBK;
+				return;
+			}
+			// Any major piece, or a bishop with another minor piece can
+			if (count[Q + offset] + count[R + offset] > 0 || (count[B + offset] >= 1 && count[N + offset] >= 1))
+			{
+				entry -> strongSide = color;
+				entry -> evaluator = evaluateKXK;
+				return;
+			}
+		}
+
+		// Without pawns, being up a minor piece or less is rarely enough to win
+		if (count[P + offset] == 0 && pieceMaterial[color] - pieceMaterial[color ^ 1] <= MATERIAL_ABS[OPENING][B])
+		{
+			if (pieceMaterial[color] < MATERIAL_ABS[OPENING][R]) { entry -> scaleFactor[color] = 0; }
+			else if (pieceMaterial[color ^ 1] <= MATERIAL_ABS[OPENING][B]) { entry -> scaleFactor[color] = SCALE_FACTOR_DRAWISH; }
+			else { entry -> scaleFactor[color] = SCALE_FACTOR_HARD_TO_WIN; }
+		}
+	}
+}
+
+// Insufficient material, neither side can mate
+int isMaterialDraw(const Game& game)
+{
+	return probeMaterialHashTable(game) -> drawn;
+}
+
+// Distance in king moves between two squares
+static inline int getSquareDistance(int square1, int square2)
+{
+	return std::max(std::abs(square1 % 8 - square2 % 8), std::abs(square1 / 8 - square2 / 8));
+}
+
+// Number of steps from the square to the four center squares (0 - 6)
+static inline int getCenterDistance(int square)
+{
+	int file = square % 8;
+	int rank = square / 8;
+	return (file < 4 ? 3 - file : file - 4) + (rank < 4 ? 3 - rank : rank - 4);
+}
+
+// Insufficient material, the score doesn't depend on the position
+int evaluateDraw(const Game&, int)
+{
+	return 0;
+}
+
+// King and enough material against a lone king: drive the king to the edge and bring the own king closer
+int evaluateKXK(const Game& game, int strongSide)
+{
+	int strongKing = getLeastSignificantBitIndex(game.bitboards[strongSide == WHITE ? K : k]);
+	int weakKing = getLeastSignificantBitIndex(game.bitboards[strongSide == WHITE ? k : K]);
+	int offset = (strongSide == WHITE ? 0 : 6);
+	int score = KNOWN_WIN_SCORE;
+
+	for (int piece = P + offset; piece < K + offset; piece ++)
+	{
+		score += countBits(game.bitboards[piece]) * MATERIAL_ABS[ENDGAME][piece];
+	}
+	score += 20 * getCenterDistance(weakKing);
+	score += 10 * (7 - getSquareDistance(strongKing, weakKing));
+
+	return (game.side == strongSide) ? score : -score;
+}
+
+// King, bishop and knight against a lone king: the king can only be mated in a corner of the bishop's colour
+int evaluateKBNK(const Game& game, int strongSide)
+{
+	int strongKing = getLeastSignificantBitIndex(game.bitboards[strongSide == WHITE ? K : k]);
+	int weakKing = getLeastSignificantBitIndex(game.bitboards[strongSide == WHITE ? k : K]);
+	int bishop = getLeastSignificantBitIndex(game.bitboards[strongSide == WHITE ? B : b]);
+	int score = KNOWN_WIN_SCORE + MATERIAL_ABS[ENDGAME][B] + MATERIAL_ABS[ENDGAME][N];
+
+	// A1 and H8 are dark squares
+	int darkBishop = ((bishop % 8 + bishop / 8) % 2 == 0);
+	int cornerDistance = darkBishop ? std::min(getSquareDistance(weakKing, A1), getSquareDistance(weakKing, H8))
+									: std::min(getSquareDistance(weakKing, A8), getSquareDistance(weakKing, H1));
+	score += 10 * getCenterDistance(weakKing);
+	score += 20 * (7 - cornerDistance);
+	score += 10 * (7 - getSquareDistance(strongKing, weakKing));
+
+	return (game.side == strongSide) ? score : -score;
+}
+
+// King and bishops (and maybe pawns) against a lone king: won like KXK with bishops on both colours or a pawn to promote,
+// a draw with all the bishops on one colour (scaled down to a draw like two knights, the weak side can still walk into a mate)
+int evaluateKBBK(const Game& game, int strongSide)
+{
+	int offset = (strongSide == WHITE ? 0 : 6);
+	Bitboard bishops = game.bitboards[B + offset];
+	if (game.bitboards[P + offset] || ((bishops & LIGHT_SQUARES) && (bishops & DARK_SQUARES))) { return evaluateKXK(game, strongSide); }
+	return 0;
+}
+
+// Sum the material and positional scores of the position from scratch
+void getPieceSquareScores(const Game& game, int& openingScore, int& endgameScore)
+{
+	openingScore = 0;
+	endgameScore = 0;
+
+	for (int piece = P; piece <= k; piece ++)
+	{
+		Bitboard bb = game.bitboards[piece];
+		while (bb)
+		{
+			int square = getLeastSignificantBitIndex(bb);
+			openingScore += PIECE_SQUARE_SCORE[OPENING][piece][square];
+			endgameScore += PIECE_SQUARE_SCORE[ENDGAME][piece][square];
+			bb = popBit(bb, square);
+		}
+	}
+}
+
+int getGamePhaseScore(const Game& game)
 {
 	int pieceScore = 0;
 	pieceScore += countBits(game.bitboards[N]) * MATERIAL_ABS[OPENING][N];
@@ -203,54 +409,85 @@ int getGamePhaseScore(Game game)
 	return pieceScore;
 }
 
-void generateFileMasks()
+/***   Look up tables, evaluated at compile time and stored as read only data   ***/
+
+// Precombine the material and positional scores, so that the game can keep their sum up to date with one look up per piece
+constexpr std::array<std::array<std::array<int, 64>, 12>, 2> generatePieceSquareScores()
 {
-    for (int square = 0; square < 64; square ++)
-    {
-        FILE_MASKS[square] = (FILE_A_MASK << (square % 8));
-    }
+	std::array<std::array<std::array<int, 64>, 12>, 2> table = {};
+	for (int phase = OPENING; phase <= ENDGAME; phase ++)
+	{
+		for (int piece = P; piece <= K; piece ++)
+		{
+			for (int square = 0; square < 64; square ++)
+			{
+				table[phase][piece][square] = MATERIAL[phase][piece] + POSITIONAL_SCORE[phase][piece][MIRROR[square]];
+				table[phase][piece + 6][square] = MATERIAL[phase][piece + 6] - POSITIONAL_SCORE[phase][piece][square];
+			}
+		}
+	}
+	return table;
 }
 
-void generateRankMasks()
+constexpr std::array<Bitboard, 64> generateFileMasks()
 {
-    for (int square = 0; square < 64; square ++)
-    {
-        RANK_MASKS[square] = (RANK_1_MASK << (8 * (square / 8)));
-    }
+	std::array<Bitboard, 64> masks = {};
+	for (int square = 0; square < 64; square ++)
+	{
+		masks[square] = (FILE_A_MASK << (square % 8));
+	}
+	return masks;
 }
 
-void generateIsolatedMasks()
+constexpr std::array<Bitboard, 64> generateRankMasks()
 {
-    for (int square = 0; square < 64; square ++)
-    {
-        ISOLATED_MASKS[square] = 0x0;
-        if (FILE_MASKS[square] & ~FILE_A_MASK)
-        {
-            ISOLATED_MASKS[square] |= (FILE_MASKS[square - 1]);
-        }
-        if (FILE_MASKS[square] & ~FILE_H_MASK)
-        {
-            ISOLATED_MASKS[square] |= (FILE_MASKS[square + 1]);
-        }
-    }
+	std::array<Bitboard, 64> masks = {};
+	for (int square = 0; square < 64; square ++)
+	{
+		masks[square] = (RANK_1_MASK << (8 * (square / 8)));
+	}
+	return masks;
 }
 
-void generatePassMasks()
+constexpr std::array<Bitboard, 64> generateIsolatedMasks()
 {
-    for (int square = 0; square < 64; square ++)
-    {
-        WHITE_PASS_MASKS[square] = FILE_MASKS[square] | ISOLATED_MASKS[square];
-        BLACK_PASS_MASKS[square] = FILE_MASKS[square] | ISOLATED_MASKS[square];
-        for (int rank = 0; rank < 8; rank ++)
-        {
-            if (square - 8 * rank >= 0)
-            {
-                WHITE_PASS_MASKS[square] &= ~RANK_MASKS[square - 8 * rank];
-            }
-            if (square + 8 * rank < 64)
-            {
-                BLACK_PASS_MASKS[square] &= ~RANK_MASKS[square + 8 * rank];
-            }
-        }
-    }
-}
\ No newline at end of file
+	std::array<Bitboard, 64> masks = {};
+	for (int square = 0; square < 64; square ++)
+	{
+		if (square % 8 != 0)
+		{
+			masks[square] |= (FILE_A_MASK << (square % 8 - 1));
+		}
+		if (square % 8 != 7)
+		{
+			masks[square] |= (FILE_A_MASK << (square % 8 + 1));
+		}
+	}
+	return masks;
+}
+
+// Files in front of a pawn (its own and the adjacent ones), from white's point of view if side is WHITE, else from black's
+constexpr std::array<Bitboard, 64> generatePassMasks(int side)
+{
+	std::array<Bitboard, 64> masks = {};
+	for (int square = 0; square < 64; square ++)
+	{
+		Bitboard files = FILE_A_MASK << (square % 8);
+		if (square % 8 != 0) { files |= (FILE_A_MASK << (square % 8 - 1)); }
+		if (square % 8 != 7) { files |= (FILE_A_MASK << (square % 8 + 1)); }
+
+		// Ranks strictly above (white) or below (black) the pawn
+		int rank = square / 8;
+		Bitboard ranks = (side == WHITE ? (rank == 7 ? 0ULL : ~0ULL << (8 * (rank + 1))) : (rank == 0 ? 0ULL : ~0ULL >> (8 * (8 - rank))));
+		masks[square] = files & ranks;
+	}
+	return masks;
+}
+
+constexpr std::array<std::array<std::array<int, 64>, 12>, 2> PIECE_SQUARE_SCORE = generatePieceSquareScores();
+
+constexpr std::array<Bitboard, 64> FILE_MASKS = generateFileMasks();
+constexpr std::array<Bitboard, 64> RANK_MASKS = generateRankMasks();
+constexpr std::array<Bitboard, 64> ISOLATED_MASKS = generateIsolatedMasks();
+constexpr std::array<Bitboard, 64> WHITE_PASS_MASKS = generatePassMasks(WHITE);
+constexpr std::array<Bitboard, 64> BLACK_PASS_MASKS = generatePassMasks(BLACK);
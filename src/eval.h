@@ -1,6 +1,8 @@
 #ifndef EVAL_H
 #define EVAL_H
 
+#include <array>
+
 #include "movegen.h"
 
 namespace Evaluation
@@ -10,8 +12,8 @@ namespace Evaluation
 }
 
 // Give a static evaluation of the position by assessing material, piece placement, pawn structures, king safety, and piece mobility
-int evaluate(Game game);
-int getGamePhaseScore(Game game);
+int evaluate(const Game& game);
+int getGamePhaseScore(const Game& game);
 
 // Material count
 const int MATERIAL[2][12] =
@@ -178,18 +180,16 @@ const int MIRROR[64] = {
      A1,  B1,  C1,  D1,  E1,  F1,  G1,  H1
 };
 
-// Masks that help determine pawn structures, king safety and piece mobility
-extern Bitboard FILE_MASKS[64];
-extern Bitboard RANK_MASKS[64];
-extern Bitboard ISOLATED_MASKS[64];
-extern Bitboard WHITE_PASS_MASKS[64];
-extern Bitboard BLACK_PASS_MASKS[64];
+// Material and positional score of a piece on a square [game phase][piece][square], black's scores mirrored and negated
+extern const std::array<std::array<std::array<int, 64>, 12>, 2> PIECE_SQUARE_SCORE;
+void getPieceSquareScores(const Game& game, int& openingScore, int& endgameScore);
 
-// Functions generating masks that help determine pawn structures, king safety and piece mobility
-void generateFileMasks();
-void generateRankMasks();
-void generateIsolatedMasks();
-void generatePassMasks();
+// Masks that help determine pawn structures, king safety and piece mobility (generated at compile time)
+extern const std::array<Bitboard, 64> FILE_MASKS;
+extern const std::array<Bitboard, 64> RANK_MASKS;
+extern const std::array<Bitboard, 64> ISOLATED_MASKS;
+extern const std::array<Bitboard, 64> WHITE_PASS_MASKS;
+extern const std::array<Bitboard, 64> BLACK_PASS_MASKS;
 
 // Penalty score for doubled pawns
 const int DOUBLE_PAWN_PENALTY = 10;
@@ -204,4 +204,53 @@ const int SEMI_OPEN_FILE_SCORE = 10;
 // Bonus score for kings that have a pawn shield before them
 const int PAWN_SHIELD_SCORE = 10;
 
+// Pawn hash table, caching the pawn structure and king shelter scores (scores are from white's point of view)
+const int PAWN_HASH_ENTRIES = 4096;
+
+struct PawnHashEntry
+{
+	uint64_t pawnKey;
+	int openingScore;
+	int endgameScore;
+	int kingSquare[2];
+	int kingShelter[2];
+};
+
+PawnHashEntry* probePawnHashTable(const Game& game);
+void evaluatePawnStructure(const Game& game, PawnHashEntry* entry);
+int evaluateKingShelter(const Game& game, int color, int square);
+
+// Material hash table, caching what the material on the board tells about the position
+const int MATERIAL_HASH_ENTRIES = 1024;
+
+// Scale factors shrink the score of a side that is ahead but can't (easily) win (out of SCALE_FACTOR_NORMAL)
+const int SCALE_FACTOR_NORMAL = 64;
+const int SCALE_FACTOR_DRAWISH = 16;
+const int SCALE_FACTOR_HARD_TO_WIN = 32;
+
+// Score given on top of the material to endgames that are won by force
+const int KNOWN_WIN_SCORE = 10000;
+
+typedef int (*EndgameEvaluator)(const Game& game, int strongSide);
+
+struct MaterialHashEntry
+{
+	uint64_t materialKey;
+	int gamePhaseScore;
+	int scaleFactor[2];
+	int drawn;
+	int strongSide;
+	EndgameEvaluator evaluator;
+};
+
+MaterialHashEntry* probeMaterialHashTable(const Game& game);
+void evaluateMaterial(const Game& game, MaterialHashEntry* entry);
+int isMaterialDraw(const Game& game);
+
+// Specialized endgame evaluators (scores are from the side to move's point of view)
+int evaluateDraw(const Game& game, int strongSide);
+int evaluateKXK(const Game& game, int strongSide);
+int evaluateKBNK(const Game& game, int strongSide);
+int evaluateKBBK(const Game& game, int strongSide);
+
 #endif
\ No newline at end of file
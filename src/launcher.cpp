@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <climits>
+#include <unistd.h>
+#include <cpuid.h>
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+// Engine builds from the most to the least demanding instruction set (see the Makefile), the first one the CPU can run is started
+const int BUILD_COUNT = 4;
+const string BUILDS[BUILD_COUNT] = {"main-x86-64-v3-pext", "main-x86-64-v3", "main-x86-64-v2", "main-x86-64"};
+const char* BUILD_LEVELS[BUILD_COUNT] = {"x86-64-v3 (pext)", "x86-64-v3", "x86-64-v2", "x86-64"};
+
+// AMD CPUs before Zen 3 (family 0x19) run pext in microcode, many times slower than the magic look ups
+static int hasFastPext()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) { return 0; }
+	// Vendor string "AuthenticAMD" is spread over ebx, edx, ecx
+	int amd = (ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163);
+	if (!amd) { return 1; }
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return 0; }
+	unsigned int family = (eax >> 8) & 0xf;
+	if (family == 0xf) { family += (eax >> 20) & 0xff; }
+	return family >= 0x19;
+}
+
+// Check the CPU (through CPUID) for every instruction set extension of a build's level
+static int isBuildSupported(int build)
+{
+	if (build == 0) { return __builtin_cpu_supports("x86-64-v3") && hasFastPext(); }
+	if (build == 1) { return __builtin_cpu_supports("x86-64-v3"); }
+	if (build == 2) { return __builtin_cpu_supports("x86-64-v2"); }
+	return 1;
+}
+
+// Directory of this executable, the engine builds sit next to it
+static string getDirectory(const char* argv0)
+{
+	char path[PATH_MAX];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	string executable = (length > 0 ? string(path, length) : string(argv0));
+	size_t slash = executable.find_last_of('/');
+	return (slash == string::npos ? string(".") : executable.substr(0, slash));
+}
+
+int main(int, char** argv)
+{
+	__builtin_cpu_init();
+	string directory = getDirectory(argv[0]);
+
+	for (int build = 0; build < BUILD_COUNT; build ++)
+	{
+		if (!isBuildSupported(build)) { continue; }
+
+		// The engine replaces this process, so the GUI keeps talking to the same pipes
+		string path = directory + "/" + BUILDS[build];
+		argv[0] = (char*)path.c_str();
+		execv(path.c_str(), argv);
+		// Only returns if the build is missing, try the next one
+		cerr << "could not start the " << BUILD_LEVELS[build] << " build " << path << endl;
+	}
+
+	cerr << "no engine build found in " << directory << endl;
+	return 1;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstring>
+#include <array>
 #include "utils.h"
 #include "masks.h"
 
@@ -8,26 +9,9 @@ using std::endl;
 using std::hex;
 using std::dec;
 
-// Pre-generated look up lists
-Bitboard PAWN_ATTACKS[2][64];
-Bitboard KNIGHT_ATTACKS[64];
-Bitboard KING_ATTACKS[64];
-Bitboard BISHOP_ATTACKS[64][512];
-Bitboard BISHOP_RELEVANT_OCCUPANCY[64];
-Bitboard ROOK_ATTACKS[64][4096];
-Bitboard ROOK_RELEVANT_OCCUPANCY[64];
-
 void AttackMasks::init()
 {
-	// Initialize magics (Not needed since they are already initialized as constants)
-	// initMagics();
-	// Initialize attacks for leapers (pawns, knights, and kings)
-	initLeaperAttacks();
-	// Initialize attacks for rooks
-	initSlideAttacks(1);
-	// Initialize attacks for bishops
-	initSlideAttacks(0);
-
+	// The look up tables are generated by the compiler (see the bottom of this file), so there is nothing left to fill in
 	if (DEBUG_MASK)
 	{
 		printDebug();
@@ -37,7 +21,7 @@ void AttackMasks::init()
 /***   Pre-generation of pieces' attacking moves   ***/
 
 // Generate pawn attacks for pre-generated pawn attack list
-Bitboard generatePawnAttacks(int square, int side)
+constexpr Bitboard generatePawnAttacks(int square, int side)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -72,7 +56,7 @@ Bitboard generatePawnAttacks(int square, int side)
 }
 
 // Generate knight attacks for pre-generated knight attack list
-Bitboard generateKnightAttacks(int square)
+constexpr Bitboard generateKnightAttacks(int square)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -103,7 +87,7 @@ Bitboard generateKnightAttacks(int square)
 }
 
 // Generate knight attacks for pre-generated knight attack list
-Bitboard generateKingAttacks(int square)
+constexpr Bitboard generateKingAttacks(int square)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -129,7 +113,7 @@ Bitboard generateKingAttacks(int square)
 }
 
 // Generate bishop attacks without considering blocks. Note that edges are not included.
-Bitboard generateBishopRelevantOccupancyMask(int square)
+constexpr Bitboard generateBishopRelevantOccupancyMask(int square)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -151,7 +135,7 @@ Bitboard generateBishopRelevantOccupancyMask(int square)
 }
 
 // Generate rook attacks without considering blocks. Note that edges are not included.
-Bitboard generateRookRelevantOccupancyMask(int square)
+constexpr Bitboard generateRookRelevantOccupancyMask(int square)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -173,10 +157,10 @@ Bitboard generateRookRelevantOccupancyMask(int square)
 }
 
 // Generate one of all the possible combinations of occupancies given the square and the relevant occupancy mask
-Bitboard generateOccupancyMasks(int index, int maskBitCount, Bitboard relevantOccupancyMask)
+constexpr Bitboard generateOccupancyMasks(int index, int maskBitCount, Bitboard relevantOccupancyMask)
 {
 	Bitboard occupancy = 0x0;
-	int square;
+	int square = 0;
 
 	for (int count = 0; count < maskBitCount; count ++)
 	{
@@ -194,7 +178,7 @@ Bitboard generateOccupancyMasks(int index, int maskBitCount, Bitboard relevantOc
 }
 
 // Generate bishop attacks while taking blocks in account. Note that edges are included in this case.
-Bitboard generateBishopAttacksOnTheFly(int square, Bitboard occupancy)
+constexpr Bitboard generateBishopAttacksOnTheFly(int square, Bitboard occupancy)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -244,7 +228,7 @@ Bitboard generateBishopAttacksOnTheFly(int square, Bitboard occupancy)
 }
 
 // Generate rook attacks while taking blocks in account. Note that edges are included in this case.
-Bitboard generateRookAttacksOnTheFly(int square, Bitboard occupancy)
+constexpr Bitboard generateRookAttacksOnTheFly(int square, Bitboard occupancy)
 {
 	Bitboard mask = 0x0;
 	Bitboard piece = setBit(0x0, square);
@@ -293,50 +277,181 @@ Bitboard generateRookAttacksOnTheFly(int square, Bitboard occupancy)
 	return mask;
 }
 
-// Initialize pawns', knights', and kings' pseudo legal move look up
-void initLeaperAttacks()
+/***   Look up tables, evaluated at compile time and stored as read only data   ***/
+
+constexpr std::array<std::array<Bitboard, 64>, 2> generatePawnAttackTable()
 {
+	std::array<std::array<Bitboard, 64>, 2> table = {};
 	for (int square = A1; square <= H8; square++)
 	{
-		PAWN_ATTACKS[WHITE][square]	= generatePawnAttacks(square, WHITE);
-		PAWN_ATTACKS[BLACK][square]	= generatePawnAttacks(square, BLACK);
-		KNIGHT_ATTACKS[square] = generateKnightAttacks(square);
-		KING_ATTACKS[square] = generateKingAttacks(square);
+		table[WHITE][square] = generatePawnAttacks(square, WHITE);
+		table[BLACK][square] = generatePawnAttacks(square, BLACK);
 	}
+	return table;
 }
 
-// Initialize rooks' and bishops' pseudo legal move look up
-void initSlideAttacks(int isRook)
+constexpr std::array<Bitboard, 64> generateLeaperAttackTable(Bitboard (*generateAttacks)(int))
 {
+	std::array<Bitboard, 64> table = {};
 	for (int square = A1; square <= H8; square++)
 	{
-		BISHOP_RELEVANT_OCCUPANCY[square] = generateBishopRelevantOccupancyMask(square);
-		ROOK_RELEVANT_OCCUPANCY[square] = generateRookRelevantOccupancyMask(square);
+		table[square] = generateAttacks(square);
+	}
+	return table;
+}
+
+constexpr std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS = generatePawnAttackTable();
+constexpr std::array<Bitboard, 64> KNIGHT_ATTACKS = generateLeaperAttackTable(generateKnightAttacks);
+constexpr std::array<Bitboard, 64> KING_ATTACKS = generateLeaperAttackTable(generateKingAttacks);
+
+// Number of entries a square's slider table takes (each backend only needs some of the arguments)
+constexpr int getSliderTableSize([[maybe_unused]] int isRook, [[maybe_unused]] Bitboard mask)
+{
+#if SLIDER_ATTACKS == PLAIN_MAGICS
+	return (isRook ? 4096 : 512);
+#else
+	return 1 << countBits(mask);
+#endif
+}
+
+// Slot of an occupancy in a square's slider table (what getSliderIndex finds at run time)
+constexpr unsigned getSliderTableIndex([[maybe_unused]] Bitboard mask, [[maybe_unused]] Bitboard magic, [[maybe_unused]] int index, 
+	[[maybe_unused]] Bitboard occupancy)
+{
+#if SLIDER_ATTACKS == PEXT_ATTACKS
+	// pext gathers the occupancy's bits in the order generateOccupancyMasks spread the index's bits
+	return index;
+#else
+	return ((occupancy & mask) * magic) >> (64 - countBits(mask));
+#endif
+}
+
+// Squares seen from every square in each direction on an empty board: north, east, north east and north west go up the board, 
+// south, west, south west and south east go down
+constexpr int RAY_STEPS[8][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}, {-1, 0}, {0, -1}, {-1, -1}, {-1, 1}};
+// Directions of bishops and rooks
+constexpr int SLIDER_DIRECTIONS[2][4] = {{2, 3, 6, 7}, {0, 1, 4, 5}};
+
+struct Rays
+{
+	Bitboard rays[8][64];
+};
+
+constexpr Rays generateRays()
+{
+	Rays rays = {};
+	for (int direction = 0; direction < 8; direction ++)
+	{
+		for (int square = A1; square <= H8; square++)
+		{
+			int rankStep = RAY_STEPS[direction][0], fileStep = RAY_STEPS[direction][1];
+			for (int rank = square / 8 + rankStep, file = square % 8 + fileStep; rank >= 0 && rank < 8 && file >= 0 && file < 8; rank += rankStep, file += fileStep)
+			{
+				rays.rays[direction][square] |= 1ull << (rank * 8 + file);
+			}
+		}
 	}
-	int magicIndex = 0;
+	return rays;
+}
+
+constexpr Rays RAYS = generateRays();
+
+// Fill the attack tables of all squares. Each ray is cut off behind its first blocker, which is a lot cheaper
+// for the compiler to evaluate than the on the fly generators above
+template <int SIZE>
+constexpr std::array<Bitboard, SIZE> generateSliderAttackTable(int isRook)
+{
+	std::array<Bitboard, SIZE> table = {};
+	Bitboard* attacks = table.data();
+
 	for (int square = A1; square <= H8; square++)
 	{
-		Bitboard relevantOccupancyMask = (isRook ? ROOK_RELEVANT_OCCUPANCY[square] : BISHOP_RELEVANT_OCCUPANCY[square]);
-		int maskBitCount = countBits(relevantOccupancyMask);
+		Bitboard mask = (isRook ? generateRookRelevantOccupancyMask(square) : generateBishopRelevantOccupancyMask(square));
+		Bitboard magic = (isRook ? ROOK_MAGICS[square] : BISHOP_MAGICS[square]);
 
-		for (int index = 0; index < (1 << maskBitCount); index ++)
+		// Walk through every subset of the mask (carry rippler), in the same order generateOccupancyMasks numbers them
+		Bitboard occupancy = 0ull;
+		int index = 0;
+		do
 		{
-			if (isRook)
+			Bitboard squareAttacks = 0ull;
+			for (int i = 0; i < 4; i ++)
 			{
-				Bitboard occupancy = generateOccupancyMasks(index, maskBitCount, relevantOccupancyMask);
-				magicIndex = ((occupancy * ROOK_MAGICS[square]) >> (64 - ROOK_OCCUPANCY_COUNT[square]));
-				ROOK_ATTACKS[square][magicIndex] = generateRookAttacksOnTheFly(square, occupancy);
+				int direction = SLIDER_DIRECTIONS[isRook][i];
+				Bitboard ray = RAYS.rays[direction][square];
+				Bitboard blockers = ray & occupancy;
+				if (blockers) { ray ^= RAYS.rays[direction][direction < 4 ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers)]; }
+				squareAttacks |= ray;
 			}
-			else
+			attacks[getSliderTableIndex(mask, magic, index, occupancy)] = squareAttacks;
+
+			occupancy = (occupancy - mask) & mask;
+			index ++;
+		} while (occupancy);
+
+		attacks += getSliderTableSize(isRook, mask);
+	}
+	return table;
+}
+
+constexpr std::array<SliderLookup, 64> generateSliderLookups(int isRook, const Bitboard* table)
+{
+	std::array<SliderLookup, 64> lookups = {};
+	for (int square = A1; square <= H8; square++)
+	{
+		SliderLookup& lookup = lookups[square];
+		lookup.mask = (isRook ? generateRookRelevantOccupancyMask(square) : generateBishopRelevantOccupancyMask(square));
+		lookup.magic = (isRook ? ROOK_MAGICS[square] : BISHOP_MAGICS[square]);
+		lookup.attacks = table;
+		lookup.shift = 64 - countBits(lookup.mask);
+		table += getSliderTableSize(isRook, lookup.mask);
+	}
+	return lookups;
+}
+
+#if SLIDER_ATTACKS == PLAIN_MAGICS
+constexpr int BISHOP_TABLE_SIZE = 64 * 512;
+constexpr int ROOK_TABLE_SIZE = 64 * 4096;
+#else
+// Squares' tables back to back, each one 2 ^ (relevant occupancy bits) entries long
+constexpr int BISHOP_TABLE_SIZE = 5248;
+constexpr int ROOK_TABLE_SIZE = 102400;
+#endif
+
+constexpr std::array<Bitboard, BISHOP_TABLE_SIZE> BISHOP_ATTACKS = generateSliderAttackTable<BISHOP_TABLE_SIZE>(0);
+constexpr std::array<Bitboard, ROOK_TABLE_SIZE> ROOK_ATTACKS = generateSliderAttackTable<ROOK_TABLE_SIZE>(1);
+constexpr std::array<SliderLookup, 64> BISHOP_LOOKUP = generateSliderLookups(0, BISHOP_ATTACKS.data());
+constexpr std::array<SliderLookup, 64> ROOK_LOOKUP = generateSliderLookups(1, ROOK_ATTACKS.data());
+
+// Squares strictly between two squares on a common rank, file or diagonal, and the whole line through them
+constexpr std::array<std::array<Bitboard, 64>, 64> generateLineMasks(int between)
+{
+	std::array<std::array<Bitboard, 64>, 64> masks = {};
+	for (int square1 = 0; square1 < 64; square1 ++)
+	{
+		for (int square2 = 0; square2 < 64; square2 ++)
+		{
+			if (square1 == square2) { continue; }
+
+			Bitboard bit1 = 1ull << square1, bit2 = 1ull << square2;
+			if (getBit(generateRookAttacksOnTheFly(square1, 0ull), square2))
 			{
-				Bitboard occupancy = generateOccupancyMasks(index, maskBitCount, relevantOccupancyMask);
-				magicIndex = ((occupancy * BISHOP_MAGICS[square]) >> (64 - BISHOP_OCCUPANCY_COUNT[square]));
-				BISHOP_ATTACKS[square][magicIndex] = generateBishopAttacksOnTheFly(square, occupancy);
+				masks[square1][square2] = (between ? generateRookAttacksOnTheFly(square1, bit2) & generateRookAttacksOnTheFly(square2, bit1) :
+											(generateRookAttacksOnTheFly(square1, 0ull) & generateRookAttacksOnTheFly(square2, 0ull)) | bit1 | bit2);
+			}
+			else if (getBit(generateBishopAttacksOnTheFly(square1, 0ull), square2))
+			{
+				masks[square1][square2] = (between ? generateBishopAttacksOnTheFly(square1, bit2) & generateBishopAttacksOnTheFly(square2, bit1) :
+											(generateBishopAttacksOnTheFly(square1, 0ull) & generateBishopAttacksOnTheFly(square2, 0ull)) | bit1 | bit2);
 			}
 		}
 	}
+	return masks;
 }
 
+constexpr std::array<std::array<Bitboard, 64>, 64> BETWEEN_MASKS = generateLineMasks(1);
+constexpr std::array<std::array<Bitboard, 64>, 64> LINE_MASKS = generateLineMasks(0);
+
 uint32_t randomSeed = 1804289383;
 
 uint32_t generateRandomUint32()
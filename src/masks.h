@@ -1,6 +1,34 @@
 #ifndef MASKS_H
 #define MASKS_H
 
+#include <array>
+
+// Slider attack backends, one is chosen at compile time with -DSLIDER_ATTACKS=...
+// PLAIN_MAGICS: a fixed size table per square (512 bishop / 4096 rook entries), about 2.3 MB
+// FANCY_MAGICS: the same magics, but each square's table only has the entries it needs, all packed in one array (about 840 KB)
+// PEXT_ATTACKS: the packed tables indexed with the BMI2 pext instruction instead of the magic multiplication (needs -mbmi2, slow on AMD before Zen 3)
+#define PLAIN_MAGICS 0
+#define FANCY_MAGICS 1
+#define PEXT_ATTACKS 2
+
+// pext is never picked just because BMI2 is there, since a -march=native build on a CPU with slow pext would get it
+#ifndef SLIDER_ATTACKS
+#define SLIDER_ATTACKS FANCY_MAGICS
+#endif
+
+// Name of the backend in use, printed by bench sliders
+#if SLIDER_ATTACKS == PLAIN_MAGICS
+#define SLIDER_ATTACKS_NAME "plain magics"
+#elif SLIDER_ATTACKS == FANCY_MAGICS
+#define SLIDER_ATTACKS_NAME "fancy magics"
+#else
+#define SLIDER_ATTACKS_NAME "pext"
+#endif
+
+#if SLIDER_ATTACKS == PEXT_ATTACKS
+#include <immintrin.h>
+#endif
+
 // Initialize pre-generated look up move lists
 namespace AttackMasks
 {
@@ -8,8 +36,6 @@ namespace AttackMasks
 	void printDebug();
 }
 
-void initLeaperAttacks();
-void initSlideAttacks(int isRook);
 
 // File masks
 const Bitboard FILE_A_MASK = 0x101010101010101;
@@ -31,13 +57,28 @@ const Bitboard RANK_6_MASK = RANK_5_MASK << 8;
 const Bitboard RANK_7_MASK = RANK_6_MASK << 8;
 const Bitboard RANK_8_MASK = RANK_7_MASK << 8;
 
-extern Bitboard PAWN_ATTACKS[2][64];
-extern Bitboard KNIGHT_ATTACKS[64];
-extern Bitboard KING_ATTACKS[64];
-extern Bitboard BISHOP_RELEVANT_OCCUPANCY[64];
-extern Bitboard BISHOP_ATTACKS[64][512];
-extern Bitboard ROOK_RELEVANT_OCCUPANCY[64];
-extern Bitboard ROOK_ATTACKS[64][4096];
+// Square colour masks (A1 is a dark square)
+const Bitboard DARK_SQUARES = 0xaa55aa55aa55aa55;
+const Bitboard LIGHT_SQUARES = ~DARK_SQUARES;
+
+// Look up tables, generated at compile time into read only data (shared by every engine process through the page cache)
+extern const std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS;
+extern const std::array<Bitboard, 64> KNIGHT_ATTACKS;
+extern const std::array<Bitboard, 64> KING_ATTACKS;
+
+// Everything needed to look up a slider's attacks from one square
+struct SliderLookup
+{
+	Bitboard mask;
+	Bitboard magic;
+	const Bitboard* attacks;
+	int shift;
+};
+
+extern const std::array<SliderLookup, 64> BISHOP_LOOKUP;
+extern const std::array<SliderLookup, 64> ROOK_LOOKUP;
+extern const std::array<std::array<Bitboard, 64>, 64> BETWEEN_MASKS;
+extern const std::array<std::array<Bitboard, 64>, 64> LINE_MASKS;
 
 // Lists for the generation of bishop, rook, and queen moves
 const int BISHOP_OCCUPANCY_COUNT[64] = {6, 5, 5, 5, 5, 5, 5, 6, 
@@ -193,21 +234,26 @@ const Bitboard BISHOP_MAGICS[64] = {
 	0x4010011029020020ULL	
 };
 
+// Index of an occupancy in a square's attack table
+static inline unsigned getSliderIndex(const SliderLookup& lookup, Bitboard occupancy)
+{
+#if SLIDER_ATTACKS == PEXT_ATTACKS
+	return _pext_u64(occupancy, lookup.mask);
+#else
+	return ((occupancy & lookup.mask) * lookup.magic) >> lookup.shift;
+#endif
+}
 // Return pseudo legal bishop moves by converting the occupancy mask into a magic index, and look up pre-generated move list
 static inline Bitboard generateBishopAttacks(int square, Bitboard occupancy)
 {
-	occupancy &= BISHOP_RELEVANT_OCCUPANCY[square];
-	occupancy *= BISHOP_MAGICS[square];
-	occupancy >>= (64 - BISHOP_OCCUPANCY_COUNT[square]);
-	return BISHOP_ATTACKS[square][occupancy];
+	const SliderLookup& lookup = BISHOP_LOOKUP[square];
+	return lookup.attacks[getSliderIndex(lookup, occupancy)];
 }
 // Return pseudo legal rook moves by converting the occupancy mask into a magic index, and look up pre-generated move list
 static inline Bitboard generateRookAttacks(int square, Bitboard occupancy)
 {
-	occupancy &= ROOK_RELEVANT_OCCUPANCY[square];
-	occupancy *= ROOK_MAGICS[square];
-	occupancy >>= (64 - ROOK_OCCUPANCY_COUNT[square]);
-	return ROOK_ATTACKS[square][occupancy];
+	const SliderLookup& lookup = ROOK_LOOKUP[square];
+	return lookup.attacks[getSliderIndex(lookup, occupancy)];
 }
 // Return pseudo legal queen moves by converting the occupancy mask into a magic index, and look up pre-generated move list
 static inline Bitboard generateQueenAttacks(int square, Bitboard occupancy)
@@ -1,11 +1,13 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cassert>
 #include <map>
 #include "utils.h"
 #include "masks.h"
 #include "eval.h"
 #include "movegen.h"
+#include "nnue.h"
 
 using std::cout;
 using std::endl;
@@ -18,9 +20,11 @@ Game::Game()
 	// Initialize piece bitboards and occupancy bitboard
 	initPieceBitboards();
 
-	// Initialize hash keys
-	initHashKey();
+	// Generate the hash keys of the starting position
 	hashKey = generateHashKey();
+	pawnKey = generatePawnKey();
+	materialKey = generateMaterialKey();
+	getPieceSquareScores(*this, openingScore, endgameScore);
 }
 
 // Alternative constructor when a fen string is passed
@@ -48,6 +52,7 @@ void Game::parseFen(string fen)
 	fiftyMoveRuleCount = 0;
 	hashKey = 0x0;
 	gamePhaseScore = 6766;
+	pinnedKnown = 0;
 
 	memset(bitboards, 0ull, sizeof(bitboards));
 	memset(occupancies, 0ull, sizeof(occupancies));
@@ -128,11 +133,13 @@ void Game::parseFen(string fen)
 		moveNum = atoi(&fen[i]);
 	}
 
-	// Initialize hash keys and generate a hash key of the current position
-	initHashKey();
+	// Generate the hash keys of the current position
 	hashKey = generateHashKey();
+	pawnKey = generatePawnKey();
+	materialKey = generateMaterialKey();
 	gamePhaseScore = getGamePhaseScore(*this);
-	checkMask = getCheckMask(side ^ 1);
+	getPieceSquareScores(*this, openingScore, endgameScore);
+	checkers = getCheckers();
 }
 
 // Initilize bitboards for 12 pieces and 3 occupancy maps
@@ -158,35 +165,8 @@ void Game::initPieceBitboards()
 	occupancies[ALL] |= occupancies[WHITE] | occupancies[BLACK];
 }
 
-void Game::initHashKey()
-{
-	// Initialize piece hash keys
-	for (int piece = P; piece <= k; piece ++)
-	{
-		for (int square = 0; square < 64; square ++)
-		{
-			PIECE_KEY[piece][square] = generateRandomUint64();
-		}
-	}
-
-	// Initialize en passant hash keys
-	for (int square = 0; square < 64; square ++)
-	{
-		ENPASSANT_KEY[square] = generateRandomUint64();
-	}
-
-	// Initialize side hash key
-	SIDE_KEY = generateRandomUint64();
-
-	// Initilize castle right hash key
-	for (int i = 0; i < 16; i ++)
-	{
-		CASTLE_KEY[i] = generateRandomUint64();
-	}
-}
-
 // Generate hash key of position from scratch
-uint64_t Game::generateHashKey()
+uint64_t Game::generateHashKey() const
 {
 	uint64_t key = 0x0;
 	uint64_t bb;
@@ -222,35 +202,135 @@ uint64_t Game::generateHashKey()
 	return key;
 }
 
-void Game::takeBack(GameState prevState)
+// Generate the key of the pawn structure from scratch (used by the pawn hash table in the evaluation)
+uint64_t Game::generatePawnKey() const
 {
-	memcpy(bitboards, prevState.bitboards, sizeof(bitboards));
-	memcpy(occupancies, prevState.occupancies, sizeof(occupancies));
-	memcpy(moveList, prevState.moveList, sizeof(moveList));
+	uint64_t key = NO_PAWNS_KEY;
+	uint64_t bb;
+	int square;
+
+	for (int piece = P; piece <= p; piece += p - P)
+	{
+		bb = bitboards[piece];
+		while (bb)
+		{
+			square = getLeastSignificantBitIndex(bb);
+			key ^= PIECE_KEY[piece][square];
+			bb = popBit(bb, square);
+		}
+	}
+
+	return key;
+}
+
+// Generate the key of the material on the board from scratch (used by the material hash table in the evaluation).
+// The n-th piece of a kind is hashed with the key of square n, so the key only depends on how many pieces there are.
+uint64_t Game::generateMaterialKey() const
+{
+	uint64_t key = 0x0;
+
+	for (int piece = P; piece <= k; piece ++)
+	{
+		for (int count = 0; count < countBits(bitboards[piece]); count ++)
+		{
+			key ^= PIECE_KEY[piece][count];
+		}
+	}
+
+	return key;
+}
+
+// Undo a move (or a null move) by flipping the squares it changed back, and restoring the rest from the undo record
+void Game::takeBack(const GameState& prevState)
+{
+	int move = prevState.move;
+
+	if (move != 0)
+	{
+		int start = getStartSquare(move);
+		int end = getEndSquare(move);
+		int piece = getPiece(move);
+		int promotion = getPromotion(move);
+
+		togglePiece(promotion != NULL_PIECE ? promotion : piece, end);
+		togglePiece(piece, start);
+
+		if (getCaptureFlag(move))
+		{
+			int captureSquare = end;
+			if (getEnpassantFlag(move)) { captureSquare = (piece == P ? end - 8 : end + 8); }
+			togglePiece(getCapturedPiece(move), captureSquare);
+		}
+
+		if (getCastlingFlag(move))
+		{
+			if (end == G1) { togglePiece(R, H1); togglePiece(R, F1); }
+			else if (end == C1) { togglePiece(R, A1); togglePiece(R, D1); }
+			else if (end == G8) { togglePiece(r, H8); togglePiece(r, F8); }
+			else if (end == C8) { togglePiece(r, A8); togglePiece(r, D8); }
+		}
+	}
+
 	side = prevState.side;
 	enPassantSquare = prevState.enPassantSquare;
 	castlingRights = prevState.castlingRights;
 	moveNum = prevState.moveNum;
 	fiftyMoveRuleCount = prevState.fiftyMoveRuleCount;
 	hashKey = prevState.hashKey;
+	pawnKey = prevState.pawnKey;
+	materialKey = prevState.materialKey;
 	gamePhaseScore = prevState.gamePhaseScore;
-	checkMask = prevState.checkMask;
+	openingScore = prevState.openingScore;
+	endgameScore = prevState.endgameScore;
+	accumulatorIndex = prevState.accumulatorIndex;
+	checkers = prevState.checkers;
+	pinnedPieces = prevState.pinnedPieces;
+	pinnedKnown = prevState.pinnedKnown;
+}
+
+// Store everything a move can't simply flip back in the undo record
+void Game::saveState(GameState& state, int move)
+{
+	state.move = move;
+	state.side = side;
+	state.enPassantSquare = enPassantSquare;
+	state.castlingRights = castlingRights;
+	state.moveNum = moveNum;
+	state.fiftyMoveRuleCount = fiftyMoveRuleCount;
+	state.hashKey = hashKey;
+	state.pawnKey = pawnKey;
+	state.materialKey = materialKey;
+	state.gamePhaseScore = gamePhaseScore;
+	state.openingScore = openingScore;
+	state.endgameScore = endgameScore;
+	state.accumulatorIndex = accumulatorIndex;
+	state.checkers = checkers;
+	state.pinnedPieces = pinnedPieces;
+	state.pinnedKnown = pinnedKnown;
+}
+
+// Put a piece on a square, updating the hash key and the material and positional scores
+void Game::addPiece(int piece, int square)
+{
+	togglePiece(piece, square);
+	hashKey ^= PIECE_KEY[piece][square];
+	openingScore += PIECE_SQUARE_SCORE[OPENING][piece][square];
+	endgameScore += PIECE_SQUARE_SCORE[ENDGAME][piece][square];
+}
+
+// Take a piece off a square, updating the hash key and the material and positional scores
+void Game::removePiece(int piece, int square)
+{
+	togglePiece(piece, square);
+	hashKey ^= PIECE_KEY[piece][square];
+	openingScore -= PIECE_SQUARE_SCORE[OPENING][piece][square];
+	endgameScore -= PIECE_SQUARE_SCORE[ENDGAME][piece][square];
 }
 
 GameState Game::makeNullMove()
 {
 	GameState prevState;
-	memcpy(prevState.bitboards, bitboards, sizeof(bitboards));
-	memcpy(prevState.occupancies, occupancies, sizeof(occupancies));
-	memcpy(prevState.moveList, moveList, sizeof(moveList));
-	prevState.side = side;
-	prevState.enPassantSquare = enPassantSquare;
-	prevState.castlingRights = castlingRights;
-	prevState.moveNum = moveNum;
-	prevState.fiftyMoveRuleCount = fiftyMoveRuleCount;
-	prevState.hashKey = hashKey;
-	prevState.gamePhaseScore = gamePhaseScore;
-	prevState.checkMask = checkMask;
+	saveState(prevState, 0);
 
 	// Reset the en passant square
 	if (enPassantSquare != SQ_NONE)
@@ -259,10 +339,14 @@ GameState Game::makeNullMove()
 	}
 	enPassantSquare = SQ_NONE;	
 
-	// Switch sides
+	// Switch sides (null moves are only made when not in check, so the opponent isn't in check either)
 	side ^= 1;
 	hashKey ^= SIDE_KEY;
+	checkers = 0ull;
+	// The pieces didn't move, so only the pinned pieces (now of the other side) are out of date
+	pinnedKnown = 0;
 
+	prevState.valid = 1;
 	return prevState;
 }
 
@@ -280,19 +364,9 @@ GameState Game::makeMove(int move, int moveType)
 	int castling = getCastlingFlag(move);
 	// int prevHashKey = hashKey;
 
-	// Store current game state in GameState structure
+	// Store what can't be flipped back in the undo record
 	GameState prevState;
-	memcpy(prevState.bitboards, bitboards, sizeof(bitboards));
-	memcpy(prevState.occupancies, occupancies, sizeof(occupancies));
-	memcpy(prevState.moveList, moveList, sizeof(moveList));
-	prevState.side = side;
-	prevState.enPassantSquare = enPassantSquare;
-	prevState.castlingRights = castlingRights;
-	prevState.moveNum = moveNum;
-	prevState.fiftyMoveRuleCount = fiftyMoveRuleCount;
-	prevState.hashKey = hashKey;
-	prevState.gamePhaseScore = gamePhaseScore;
-	prevState.checkMask = checkMask;
+	saveState(prevState, move);
 
 	// Check move flag
 	if (moveType == ONLY_CAPTURES && capture == 0)
@@ -301,38 +375,31 @@ GameState Game::makeMove(int move, int moveType)
 		return prevState;
 	}
 
-	if (checkMask != 0 && (piece != K && piece != k) && (((1ull << end) & checkMask) == 0))
-	{
-		prevState.valid = 0; 
-		return prevState;
-	}
+	pinnedKnown = 0;
 
-	if (checkMask != 0 && (piece == K && piece == k) && ((1ull << end) & checkMask))
+	// Handle captures (before the piece lands on the square, so that the occupancies stay right)
+	if (capture == 1 && enPassant == 0)
 	{
-		prevState.valid = 0; 
-		return prevState;
+		removePiece(capturedPiece, end);
+		if (capturedPiece == P || capturedPiece == p) { pawnKey ^= PIECE_KEY[capturedPiece][end]; }
 	}
 
 	// Make move
-	bitboards[piece] = popBit(bitboards[piece], start);
-	hashKey ^= PIECE_KEY[piece][start];
-	bitboards[piece] = setBit(bitboards[piece], end);
-	hashKey ^= PIECE_KEY[piece][end];
+	removePiece(piece, start);
+	addPiece(piece, end);
 
-	// Handle captures
-	if (capture == 1 && enPassant == 0)
+	// Pawn moves change the pawn structure (a promoted pawn leaves it)
+	if (piece == P || piece == p)
 	{
-		bitboards[capturedPiece] = popBit(bitboards[capturedPiece], end);
-		hashKey ^= PIECE_KEY[capturedPiece][end];
+		pawnKey ^= PIECE_KEY[piece][start];
+		if (promotion == NULL_PIECE) { pawnKey ^= PIECE_KEY[piece][end]; }
 	}
 
 	// Handle pawn promotions
 	if (promotion != NULL_PIECE)
 	{
-		bitboards[piece] = popBit(bitboards[piece], end);
-		hashKey ^= PIECE_KEY[piece][end];
-		bitboards[promotion] = setBit(bitboards[promotion], end);
-		hashKey ^= PIECE_KEY[promotion][end];
+		removePiece(piece, end);
+		addPiece(promotion, end);
 	}
 
 	// Handle en passant
@@ -340,16 +407,27 @@ GameState Game::makeMove(int move, int moveType)
 	{
 		if (piece == P)
 		{
-			bitboards[p] = popBit(bitboards[p], end - 8);
-			hashKey ^= PIECE_KEY[p][end - 8];
+			removePiece(p, end - 8);
+			pawnKey ^= PIECE_KEY[p][end - 8];
 		}
 		if (piece == p)
 		{
-			bitboards[P] = popBit(bitboards[P], end + 8);
-			hashKey ^= PIECE_KEY[P][end + 8];
+			removePiece(P, end + 8);
+			pawnKey ^= PIECE_KEY[P][end + 8];
 		}
 	}
 
+	// Captures and promotions change the material (the last piece of a kind is hashed with the key of square count - 1)
+	if (capture == 1)
+	{
+		materialKey ^= PIECE_KEY[capturedPiece][countBits(bitboards[capturedPiece])];
+	}
+	if (promotion != NULL_PIECE)
+	{
+		materialKey ^= PIECE_KEY[piece][countBits(bitboards[piece])];
+		materialKey ^= PIECE_KEY[promotion][countBits(bitboards[promotion]) - 1];
+	}
+
 	// Reset the en passant square
 	if (enPassantSquare != SQ_NONE)
 	{
@@ -369,31 +447,23 @@ GameState Game::makeMove(int move, int moveType)
 	{
 		if (end == G1)
 		{
-			bitboards[R] = popBit(bitboards[R], H1);
-			hashKey ^= PIECE_KEY[R][H1];
-			bitboards[R] = setBit(bitboards[R], F1);
-			hashKey ^= PIECE_KEY[R][F1];
+			removePiece(R, H1);
+			addPiece(R, F1);
 		}
 		else if (end == C1)
 		{
-			bitboards[R] = popBit(bitboards[R], A1);
-			hashKey ^= PIECE_KEY[R][A1];
-			bitboards[R] = setBit(bitboards[R], D1);
-			hashKey ^= PIECE_KEY[R][D1];
+			removePiece(R, A1);
+			addPiece(R, D1);
 		}
 		else if (end == G8)
 		{
-			bitboards[r] = popBit(bitboards[r], H8);
-			hashKey ^= PIECE_KEY[r][H8];
-			bitboards[r] = setBit(bitboards[r], F8);
-			hashKey ^= PIECE_KEY[r][F8];
+			removePiece(r, H8);
+			addPiece(r, F8);
 		}
 		else if (end == C8)
 		{
-			bitboards[r] = popBit(bitboards[r], A8);
-			hashKey ^= PIECE_KEY[r][A8];
-			bitboards[r] = setBit(bitboards[r], D8);
-			hashKey ^= PIECE_KEY[r][D8];
+			removePiece(r, A8);
+			addPiece(r, D8);
 		}
 	}
 
@@ -421,21 +491,6 @@ GameState Game::makeMove(int move, int moveType)
 
 	hashKey ^= CASTLE_KEY[castlingRights];
 
-	// Reset occupancy masks
-	occupancies[WHITE] = 0ull;
-	occupancies[BLACK] = 0ull;
-	occupancies[ALL] = 0ull;
-	// Loop over pieces to update occupancy mask
-	for (int whitePiece = P; whitePiece <= K; whitePiece ++)
-	{
-		occupancies[WHITE] |= bitboards[whitePiece];
-	}
-	for (int blackPiece = p; blackPiece <= k; blackPiece ++)
-	{
-		occupancies[BLACK] |= bitboards[blackPiece];
-	}
-	occupancies[ALL] = occupancies[BLACK] | occupancies[WHITE];
-
 	// Update move number
 	if (side == BLACK)
 	{
@@ -470,32 +525,54 @@ GameState Game::makeMove(int move, int moveType)
 		// cout << piece << SQUARES[start] << SQUARES[end] << castlingRights << endl;
 		uint64_t hashFromScratch = generateHashKey();
 		assert(hashKey == hashFromScratch);
+		assert(pawnKey == generatePawnKey());
+		assert(materialKey == generateMaterialKey());
+
+		int openingScoreFromScratch, endgameScoreFromScratch;
+		getPieceSquareScores(*this, openingScoreFromScratch, endgameScoreFromScratch);
+		assert(openingScore == openingScoreFromScratch && endgameScore == endgameScoreFromScratch);
+
+		// Moves come from the legal move generator, so the side that just moved can't have left its king in check
+		assert(!isSquareAttacked(getLeastSignificantBitIndex(bitboards[side == WHITE ? k : K]), side));
 
 		// int gamePhaseScoreFromScratch = getGamePhaseScore(*this);
 		// assert(gamePhaseScore == gamePhaseScoreFromScratch);		
 	}
 
-	checkMask = getCheckMask(side ^ 1);
+	// The move is legal, so only the opponent can be in check now
+	checkers = getCheckers();
 
-	Bitboard playerKingAfter = (side == BLACK ? bitboards[K] : bitboards[k]);
-	if (isSquareAttacked(getLeastSignificantBitIndex(playerKingAfter), side))
+	// Update the network's first layer
+	if (NNUE::enabled)
 	{
-		prevState.valid = 0;
-		takeBack(prevState);
-		return prevState;
+		NNUE::updateAccumulator(*this, move);
 	}
 
 	prevState.valid = 1;
 	return prevState;
 }
 
-void Game::generateAllMoves()
+// Generate the pseudo legal moves into the caller's move list
+void Game::generateAllMoves(MoveList& moveList, int moveType)
 {
-	// Reset move list every time we generate moves
-	memset(moveList, 0, sizeof(moveList));
-	// Initialize a pointer that points to moveList's first element;
-	int *pointer = moveList;
+	// Initialize a pointer that points to the list's first element;
+	int *pointer = moveList.moves;
 	int pieceStart = (side == WHITE ? 0 : 6);
+
+	// Squares pieces may move to: enemy pieces for captures, empty squares for quiet moves
+	Bitboard targets = ~occupancies[side];
+	if (moveType == ONLY_CAPTURES) { targets = occupancies[side ^ 1]; }
+	if (moveType == ONLY_QUIETS) { targets = ~occupancies[ALL]; }
+
+	// In check, other pieces have to capture the checker or block the check (with two checkers only the king can move)
+	int kingSquare = getLeastSignificantBitIndex(bitboards[side == WHITE ? K : k]);
+	Bitboard checkMask = ~0ull;
+	if (checkers)
+	{
+		checkMask = (checkers & (checkers - 1)) ? 0ull : checkers | BETWEEN_MASKS[kingSquare][getLeastSignificantBitIndex(checkers)];
+	}
+	// Pinned pieces can only move along the line through their king
+	Bitboard pinned = getPinned();
 	
 	for (int piece = pieceStart; piece <= pieceStart + 5; piece++)
 	{
@@ -507,34 +584,41 @@ void Game::generateAllMoves()
 				// Quiet pawn moves
 				int start = getLeastSignificantBitIndex(bb);
 				int end = start + 8;
+				Bitboard legalTargets = checkMask & (getBit(pinned, start) ? LINE_MASKS[kingSquare][start] : ~0ull);
 				// If end square is inside the board and the end square is not occupied
-				if (!(end > H8) && !getBit(occupancies[ALL], end))
+				if (moveType != ONLY_CAPTURES && !(end > H8) && !getBit(occupancies[ALL], end))
 				{
 					// Pawn promotions (white pawn pushes from the 7th rank)
 					if (start >= A7 && start <= H7)
 					{
-						*pointer = encodeMove(start, end, piece, Q, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, R, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, B, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, N, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						if (getBit(legalTargets, end))
+						{
+							*pointer = encodeMove(start, end, piece, Q, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, R, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, B, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, N, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						}
 					}
 					else
 					{
 						// One square pawn push
-						*pointer = encodeMove(start, end, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						if (getBit(legalTargets, end))
+						{
+							*pointer = encodeMove(start, end, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						}
 						// Two square pawn push
-						if ((start >= A2 && start <= H2) && !getBit(occupancies[ALL], end + 8))
+						if ((start >= A2 && start <= H2) && !getBit(occupancies[ALL], end + 8) && getBit(legalTargets, end + 8))
 						{
 							*pointer = encodeMove(start, end + 8, piece, NULL_PIECE, NULL_PIECE, 0, 1, 0, 0); pointer++;
 						}
 					}
 				}
 				// Captures
-				Bitboard attacks = PAWN_ATTACKS[WHITE][start] & occupancies[BLACK];
+				Bitboard attacks = (moveType != ONLY_QUIETS ? PAWN_ATTACKS[WHITE][start] & occupancies[BLACK] & legalTargets : 0ull);
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					// Handle promotion captures
 					if (start >= A7 && start <= H7)
@@ -549,12 +633,11 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, capturedPiece, 1, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				// En passant
-				if (enPassantSquare != SQ_NONE)
+				if (moveType != ONLY_QUIETS && enPassantSquare != SQ_NONE)
 				{
-					if (PAWN_ATTACKS[WHITE][start] & (1ULL << enPassantSquare))
+					if ((PAWN_ATTACKS[WHITE][start] & (1ULL << enPassantSquare)) && isEnPassantLegal(start, kingSquare))
 					{
 						*pointer = encodeMove(start, enPassantSquare, P, NULL_PIECE, p, 1, 0, 1, 0); pointer++;					
 					}
@@ -569,34 +652,41 @@ void Game::generateAllMoves()
 				// Quiet pawn moves
 				int start = getLeastSignificantBitIndex(bb);
 				int end = start - 8;
+				Bitboard legalTargets = checkMask & (getBit(pinned, start) ? LINE_MASKS[kingSquare][start] : ~0ull);
 				// If end square is inside the board and the end square is not occupied
-				if (!(end < A1) && !getBit(occupancies[ALL], end))
+				if (moveType != ONLY_CAPTURES && !(end < A1) && !getBit(occupancies[ALL], end))
 				{
 					// Pawn promotions (white pawn pushes from the 7th rank)
 					if (start >= A2 && start <= H2)
 					{
-						*pointer = encodeMove(start, end, piece, q, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, r, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, b, NULL_PIECE, 0, 0, 0, 0); pointer++;
-						*pointer = encodeMove(start, end, piece, n, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						if (getBit(legalTargets, end))
+						{
+							*pointer = encodeMove(start, end, piece, q, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, r, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, b, NULL_PIECE, 0, 0, 0, 0); pointer++;
+							*pointer = encodeMove(start, end, piece, n, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						}
 					}
 					else
 					{
 						// One square pawn push
-						*pointer = encodeMove(start, end, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						if (getBit(legalTargets, end))
+						{
+							*pointer = encodeMove(start, end, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;
+						}
 						// Two square pawn push
-						if ((start >= A7 && start <= H7) && !getBit(occupancies[ALL], end - 8))
+						if ((start >= A7 && start <= H7) && !getBit(occupancies[ALL], end - 8) && getBit(legalTargets, end - 8))
 						{
 							*pointer = encodeMove(start, end - 8, piece, NULL_PIECE, NULL_PIECE, 0, 1, 0, 0); pointer++;
 						}
 					}
 				}
 				// Captures
-				Bitboard attacks = PAWN_ATTACKS[BLACK][start] & occupancies[WHITE];
+				Bitboard attacks = (moveType != ONLY_QUIETS ? PAWN_ATTACKS[BLACK][start] & occupancies[WHITE] & legalTargets : 0ull);
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					// Handle promotion captures
 					if (start >= A2 && start <= H2)
@@ -611,12 +701,11 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, capturedPiece, 1, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				// En passant
-				if (enPassantSquare != SQ_NONE)
+				if (moveType != ONLY_QUIETS && enPassantSquare != SQ_NONE)
 				{
-					if (PAWN_ATTACKS[BLACK][start] & (1ULL << enPassantSquare))
+					if ((PAWN_ATTACKS[BLACK][start] & (1ULL << enPassantSquare)) && isEnPassantLegal(start, kingSquare))
 					{
 						*pointer = encodeMove(start, enPassantSquare, p, NULL_PIECE, P, 1, 0, 1, 0); pointer++;					
 					}
@@ -625,13 +714,13 @@ void Game::generateAllMoves()
 			}
 		}
 		// Handle white kings castling moves
-		if (piece == K)
+		if (piece == K && moveType != ONLY_CAPTURES)
 		{
 			if (castlingRights & WK)
 			{
 				if (!getBit(occupancies[ALL], F1) && !getBit(occupancies[ALL], G1))
 				{
-					if (!isSquareAttacked(E1, BLACK) && !isSquareAttacked(F1, BLACK) && !isSquareAttacked(G1, BLACK))
+					if (!getAttackedSquares((1ull << E1) | (1ull << F1) | (1ull << G1), BLACK))
 					{
 						*pointer = encodeMove(E1, G1, K, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); pointer++;						
 					}
@@ -641,7 +730,7 @@ void Game::generateAllMoves()
 			{
 				if (!getBit(occupancies[ALL], D1) && !getBit(occupancies[ALL], C1) && !getBit(occupancies[ALL], B1))
 				{
-					if (!isSquareAttacked(E1, BLACK) && !isSquareAttacked(D1, BLACK) && !isSquareAttacked(C1, BLACK))
+					if (!getAttackedSquares((1ull << E1) | (1ull << D1) | (1ull << C1), BLACK))
 					{
 						*pointer = encodeMove(E1, C1, K, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); pointer++;						
 					}
@@ -649,13 +738,13 @@ void Game::generateAllMoves()
 			}
 		}
 		// Handle black kings castling moves
-		else if (piece == k)
+		else if (piece == k && moveType != ONLY_CAPTURES)
 		{
 			if (castlingRights & BK)
 			{
 				if (!getBit(occupancies[ALL], F8) && !getBit(occupancies[ALL], G8))
 				{
-					if (!isSquareAttacked(E8, WHITE) && !isSquareAttacked(F8, WHITE) && !isSquareAttacked(G8, WHITE))
+					if (!getAttackedSquares((1ull << E8) | (1ull << F8) | (1ull << G8), WHITE))
 					{
 						*pointer = encodeMove(E8, G8, k, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); pointer++;						
 					}
@@ -665,7 +754,7 @@ void Game::generateAllMoves()
 			{
 				if (!getBit(occupancies[ALL], D8) && !getBit(occupancies[ALL], C8) && !getBit(occupancies[ALL], B8))
 				{
-					if (!isSquareAttacked(E8, WHITE) && !isSquareAttacked(D8, WHITE) && !isSquareAttacked(C8, WHITE))
+					if (!getAttackedSquares((1ull << E8) | (1ull << D8) | (1ull << C8), WHITE))
 					{
 						*pointer = encodeMove(E8, C8, k, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); pointer++;						
 					}
@@ -680,11 +769,13 @@ void Game::generateAllMoves()
 			while (bb)
 			{
 				start = getLeastSignificantBitIndex(bb);
-				attacks = KING_ATTACKS[start] & (~occupancies[side]);
+				attacks = KING_ATTACKS[start] & targets;
+				// The king can't step onto an attacked square
+				if (attacks) { attacks = getSafeKingSquares(attacks); }
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					if (capturedPiece != NULL_PIECE)
 					{
@@ -694,7 +785,6 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				bb = popBit(bb, start);
 			}
@@ -707,11 +797,12 @@ void Game::generateAllMoves()
 			while (bb)
 			{
 				start = getLeastSignificantBitIndex(bb);
-				attacks = KNIGHT_ATTACKS[start] & (~occupancies[side]);
+				attacks = KNIGHT_ATTACKS[start] & targets & checkMask;
+				if (getBit(pinned, start)) { attacks &= LINE_MASKS[kingSquare][start]; }
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					if (capturedPiece != NULL_PIECE)
 					{
@@ -721,7 +812,6 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				bb = popBit(bb, start);
 			}
@@ -734,11 +824,12 @@ void Game::generateAllMoves()
 			while (bb)
 			{
 				start = getLeastSignificantBitIndex(bb);
-				attacks = generateBishopAttacks(start, occupancies[ALL]) & (~occupancies[side]);
+				attacks = generateBishopAttacks(start, occupancies[ALL]) & targets & checkMask;
+				if (getBit(pinned, start)) { attacks &= LINE_MASKS[kingSquare][start]; }
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					if (capturedPiece != NULL_PIECE)
 					{
@@ -748,7 +839,6 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				bb = popBit(bb, start);
 			}
@@ -761,11 +851,12 @@ void Game::generateAllMoves()
 			while (bb)
 			{
 				start = getLeastSignificantBitIndex(bb);
-				attacks = generateRookAttacks(start, occupancies[ALL]) & (~occupancies[side]);
+				attacks = generateRookAttacks(start, occupancies[ALL]) & targets & checkMask;
+				if (getBit(pinned, start)) { attacks &= LINE_MASKS[kingSquare][start]; }
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					if (capturedPiece != NULL_PIECE)
 					{
@@ -775,7 +866,6 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				bb = popBit(bb, start);
 			}
@@ -788,11 +878,12 @@ void Game::generateAllMoves()
 			while (bb)
 			{
 				start = getLeastSignificantBitIndex(bb);
-				attacks = generateQueenAttacks(start, occupancies[ALL]) & (~occupancies[side]);
+				attacks = generateQueenAttacks(start, occupancies[ALL]) & targets & checkMask;
+				if (getBit(pinned, start)) { attacks &= LINE_MASKS[kingSquare][start]; }
 				int target, capturedPiece;
 				while (attacks)
 				{
-					target = getLeastSignificantBitIndex(attacks);
+					target = popLeastSignificantBit(attacks);
 					capturedPiece = getCaptures(target, side);
 					if (capturedPiece != NULL_PIECE)
 					{
@@ -802,18 +893,129 @@ void Game::generateAllMoves()
 					{
 						*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;						
 					}
-					attacks = popBit(attacks, target);
 				}
 				bb = popBit(bb, start);
 			}
 		}
 	}
+	moveList.count = pointer - moveList.moves;
+
 	if (DEBUG_GAME)
 	{
-		// printMoveList(*this);
+		// printMoveList(moveList);
 	}
 }
 
+// Add a pawn move to the list, as the four promotions when it reaches the last rank
+static inline int* addPawnMove(int* pointer, int start, int end, int piece, int capturedPiece, int doublePush)
+{
+	int capture = (capturedPiece != NULL_PIECE);
+	if (end >= A8 || end <= H1)
+	{
+		int offset = (piece == P ? 0 : 6);
+		*pointer = encodeMove(start, end, piece, Q + offset, capturedPiece, capture, 0, 0, 0); pointer++;
+		*pointer = encodeMove(start, end, piece, R + offset, capturedPiece, capture, 0, 0, 0); pointer++;
+		*pointer = encodeMove(start, end, piece, B + offset, capturedPiece, capture, 0, 0, 0); pointer++;
+		*pointer = encodeMove(start, end, piece, N + offset, capturedPiece, capture, 0, 0, 0); pointer++;
+	}
+	else
+	{
+		*pointer = encodeMove(start, end, piece, NULL_PIECE, capturedPiece, capture, doublePush, 0, 0); pointer++;
+	}
+	return pointer;
+}
+
+// Generate the legal moves of a side in check: king moves to safe squares and, against a single checker, captures of it and interpositions
+void Game::generateEvasions(MoveList& moveList)
+{
+	int *pointer = moveList.moves;
+	int offset = (side == WHITE ? 0 : 6);
+	int king = K + offset;
+	int kingSquare = getLeastSignificantBitIndex(bitboards[king]);
+
+	// The king can't step onto an attacked square
+	Bitboard attacks = getSafeKingSquares(KING_ATTACKS[kingSquare] & ~occupancies[side]);
+	while (attacks)
+	{
+		int target = popLeastSignificantBit(attacks);
+		int capturedPiece = getCaptures(target, side);
+		*pointer = encodeMove(kingSquare, target, king, NULL_PIECE, capturedPiece, capturedPiece != NULL_PIECE, 0, 0, 0); pointer++;
+	}
+
+	// With two checkers only the king can move
+	if (checkers & (checkers - 1))
+	{
+		moveList.count = pointer - moveList.moves;
+		return;
+	}
+
+	int checkerSquare = getLeastSignificantBitIndex(checkers);
+	int checker = getCaptures(checkerSquare, side);
+	Bitboard blocks = BETWEEN_MASKS[kingSquare][checkerSquare];
+	// A pinned piece can't leave its line through the king, which only meets the checking ray at the king
+	Bitboard movable = ~getPinned();
+
+	// Pawns capture the checker, or push onto the checking ray
+	int pawn = P + offset;
+	int forward = (side == WHITE ? NORTH : SOUTH);
+	Bitboard bb = bitboards[pawn] & movable;
+	while (bb)
+	{
+		int start = getLeastSignificantBitIndex(bb);
+		if (PAWN_ATTACKS[side][start] & checkers)
+		{
+			pointer = addPawnMove(pointer, start, checkerSquare, pawn, checker, 0);
+		}
+		int end = start + forward;
+		if (!getBit(occupancies[ALL], end))
+		{
+			if (getBit(blocks, end)) { pointer = addPawnMove(pointer, start, end, pawn, NULL_PIECE, 0); }
+			int doubleEnd = end + forward;
+			int startRank = (side == WHITE ? RANK_2 : RANK_7);
+			if (start / 8 == startRank && !getBit(occupancies[ALL], doubleEnd) && getBit(blocks, doubleEnd))
+			{
+				pointer = addPawnMove(pointer, start, doubleEnd, pawn, NULL_PIECE, 1);
+			}
+		}
+		// En passant removes a checking pawn that has just been pushed, or lands on the checking ray
+		if (enPassantSquare != SQ_NONE && (PAWN_ATTACKS[side][start] & (1ull << enPassantSquare)) && isEnPassantLegal(start, kingSquare))
+		{
+			*pointer = encodeMove(start, enPassantSquare, pawn, NULL_PIECE, P + 6 - offset, 1, 0, 1, 0); pointer++;
+		}
+		bb = popBit(bb, start);
+	}
+
+	// Pieces capture the checker or interpose
+	Bitboard targets = checkers | blocks;
+	for (int piece = N + offset; piece <= Q + offset; piece++)
+	{
+		bb = bitboards[piece] & movable;
+		while (bb)
+		{
+			int start = getLeastSignificantBitIndex(bb);
+			if (piece == N || piece == n) { attacks = KNIGHT_ATTACKS[start]; }
+			else if (piece == B || piece == b) { attacks = generateBishopAttacks(start, occupancies[ALL]); }
+			else if (piece == R || piece == r) { attacks = generateRookAttacks(start, occupancies[ALL]); }
+			else { attacks = generateQueenAttacks(start, occupancies[ALL]); }
+			attacks &= targets;
+			while (attacks)
+			{
+				int target = popLeastSignificantBit(attacks);
+				if (target == checkerSquare)
+				{
+					*pointer = encodeMove(start, target, piece, NULL_PIECE, checker, 1, 0, 0, 0); pointer++;
+				}
+				else
+				{
+					*pointer = encodeMove(start, target, piece, NULL_PIECE, NULL_PIECE, 0, 0, 0, 0); pointer++;
+				}
+			}
+			bb = popBit(bb, start);
+		}
+	}
+	moveList.count = pointer - moveList.moves;
+}
+
 int Game::getCaptures(int target, int attacker)
 {
 	int pieceStart = (attacker == WHITE ? 6 : 0);
@@ -827,40 +1029,186 @@ int Game::getCaptures(int target, int attacker)
 	return NULL_PIECE;	
 }
 
+// Check that a move from elsewhere (transposition table, killers) is one generateAllMoves could have produced in this position
+int Game::isPseudoLegal(int move)
+{
+	if (move == 0) { return 0; }
+
+	int start = getStartSquare(move);
+	int end = getEndSquare(move);
+	int piece = getPiece(move);
+	int promotion = getPromotion(move);
+	int pieceStart = (side == WHITE ? 0 : 6);
+
+	if (piece < pieceStart || piece > pieceStart + 5 || !getBit(bitboards[piece], start)) { return 0; }
+
+	// Castling moves are only checked against the castling conditions
+	if (getCastlingFlag(move))
+	{
+		if (piece == K && start == E1 && end == G1) { return (castlingRights & WK) && !getBit(occupancies[ALL], F1) && !getBit(occupancies[ALL], G1) && !getAttackedSquares((1ull << E1) | (1ull << F1) | (1ull << G1), BLACK) && move == encodeMove(E1, G1, K, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); }
+		if (piece == K && start == E1 && end == C1) { return (castlingRights & WQ) && !getBit(occupancies[ALL], D1) && !getBit(occupancies[ALL], C1) && !getBit(occupancies[ALL], B1) && !getAttackedSquares((1ull << E1) | (1ull << D1) | (1ull << C1), BLACK) && move == encodeMove(E1, C1, K, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); }
+		if (piece == k && start == E8 && end == G8) { return (castlingRights & BK) && !getBit(occupancies[ALL], F8) && !getBit(occupancies[ALL], G8) && !getAttackedSquares((1ull << E8) | (1ull << F8) | (1ull << G8), WHITE) && move == encodeMove(E8, G8, k, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); }
+		if (piece == k && start == E8 && end == C8) { return (castlingRights & BQ) && !getBit(occupancies[ALL], D8) && !getBit(occupancies[ALL], C8) && !getBit(occupancies[ALL], B8) && !getAttackedSquares((1ull << E8) | (1ull << D8) | (1ull << C8), WHITE) && move == encodeMove(E8, C8, k, NULL_PIECE, NULL_PIECE, 0, 0, 0, 1); }
+		return 0;
+	}
+
+	int capturedPiece = getCaptures(end, side);
+	int capture = (capturedPiece != NULL_PIECE);
+	int doublePush = 0;
+	int enPassant = 0;
+
+	if (getBit(occupancies[side], end)) { return 0; }
+
+	if (piece == P || piece == p)
+	{
+		int forward = (piece == P ? 8 : -8);
+		int promotionRank = (piece == P ? RANK_8 : RANK_1);
+		int startRank = (piece == P ? RANK_2 : RANK_7);
+
+		if (end == enPassantSquare && getBit(PAWN_ATTACKS[side][start], end))
+		{
+			capturedPiece = (piece == P ? p : P);
+			capture = 1;
+			enPassant = 1;
+		}
+		else if (capture)
+		{
+			if (!getBit(PAWN_ATTACKS[side][start], end)) { return 0; }
+		}
+		else if (end == start + 2 * forward)
+		{
+			if (start / 8 != startRank || getBit(occupancies[ALL], start + forward)) { return 0; }
+			doublePush = 1;
+		}
+		else if (end != start + forward) { return 0; }
+
+		// Pawns reaching the last rank have to promote (to a piece of their own colour)
+		if ((end / 8 == promotionRank) != (promotion != NULL_PIECE)) { return 0; }
+		if (promotion != NULL_PIECE && (promotion < pieceStart + 1 || promotion > pieceStart + 4)) { return 0; }
+	}
+	else
+	{
+		Bitboard attacks = 0ull;
+		if (piece == N || piece == n) { attacks = KNIGHT_ATTACKS[start]; }
+		else if (piece == B || piece == b) { attacks = generateBishopAttacks(start, occupancies[ALL]); }
+		else if (piece == R || piece == r) { attacks = generateRookAttacks(start, occupancies[ALL]); }
+		else if (piece == Q || piece == q) { attacks = generateQueenAttacks(start, occupancies[ALL]); }
+		else { attacks = KING_ATTACKS[start]; }
+
+		if (!getBit(attacks, end)) { return 0; }
+	}
+
+	// Flags and captured piece have to match what the position says, since makeMove trusts them
+	return move == encodeMove(start, end, piece, promotion, capturedPiece, capture, doublePush, enPassant, 0);
+}
+
 uint64_t Game::isSquareAttacked(int square, int attacker)
 {
 	return (PAWN_ATTACKS[attacker ^ 1][square] & bitboards[p - 6 * attacker]) | (KNIGHT_ATTACKS[square] & bitboards[n - 6 * attacker]) | (KING_ATTACKS[square] & bitboards[k - 6 * attacker]) | (generateBishopAttacks(square, occupancies[ALL]) & bitboards[b - 6 * attacker]) | 
 						(generateRookAttacks(square, occupancies[ALL]) & bitboards[r - 6 * attacker]) | (generateQueenAttacks(square, occupancies[ALL]) & bitboards[q - 6 * attacker]);
 }
 
-uint64_t Game::getCheckMask(int attacker)
+// Pieces of the attacker attacking a square, with the given occupancy for the sliders
+uint64_t Game::getAttackers(int square, int attacker, Bitboard occupancy) const
+{
+	int offset = (attacker == WHITE ? 0 : 6);
+	Bitboard diagonalSliders = bitboards[B + offset] | bitboards[Q + offset];
+	Bitboard straightSliders = bitboards[R + offset] | bitboards[Q + offset];
+
+	return (PAWN_ATTACKS[attacker ^ 1][square] & bitboards[P + offset]) | (KNIGHT_ATTACKS[square] & bitboards[N + offset]) | (KING_ATTACKS[square] & bitboards[K + offset]) |
+		   (generateBishopAttacks(square, occupancy) & diagonalSliders) | (generateRookAttacks(square, occupancy) & straightSliders);
+}
+
+// Enemy pieces giving check to the side to move
+uint64_t Game::getCheckers()
 {
-	Bitboard playerKing = (attacker == BLACK ? bitboards[K] : bitboards[k]);
-	int square = getLeastSignificantBitIndex(playerKing);
+	return getAttackers(getLeastSignificantBitIndex(bitboards[side == WHITE ? K : k]), side ^ 1, occupancies[ALL]);
+}
 
-	uint64_t leaperCheck = (PAWN_ATTACKS[attacker ^ 1][square] & bitboards[p - 6 * attacker]) | (KNIGHT_ATTACKS[square] & bitboards[n - 6 * attacker]);
-	uint64_t batk = generateBishopAttacks(square, occupancies[ALL]);
-	uint64_t ratk = generateRookAttacks(square, occupancies[ALL]);
-	uint64_t bishopCheck = batk & bitboards[b - 6 * attacker];
-	uint64_t rookCheck = ratk & bitboards[r - 6 * attacker];
-	uint64_t queenCheck = 0ull;
+// Pieces of the side to move that can't leave the line between their king and an enemy slider
+uint64_t Game::getPinnedPieces(int kingSquare) const
+{
+	int offset = (side == WHITE ? 6 : 0);
+	Bitboard pinned = 0ull;
+	Bitboard snipers = (generateBishopAttacks(kingSquare, 0ull) & (bitboards[B + offset] | bitboards[Q + offset])) |
+					   (generateRookAttacks(kingSquare, 0ull) & (bitboards[R + offset] | bitboards[Q + offset]));
 
-	if (bishopCheck)
+	while (snipers)
 	{
-		bishopCheck = batk & ((bishopCheck) | generateBishopAttacks(getLeastSignificantBitIndex(bishopCheck), occupancies[ALL]));  
+		int square = getLeastSignificantBitIndex(snipers);
+		Bitboard blockers = BETWEEN_MASKS[kingSquare][square] & occupancies[ALL];
+		if (blockers && (blockers & (blockers - 1)) == 0 && (blockers & occupancies[side])) { pinned |= blockers; }
+		snipers = popBit(snipers, square);
 	}
-	if (rookCheck)
+
+	return pinned;
+}
+
+// Squares among the given ones that a side attacks
+uint64_t Game::getAttackedSquares(Bitboard squares, int attacker) const
+{
+	Bitboard attacked = 0ull;
+	while (squares)
 	{
-		rookCheck = ratk & (rookCheck | generateRookAttacks(getLeastSignificantBitIndex(rookCheck), occupancies[ALL]));
+		int square = popLeastSignificantBit(squares);
+		if (getAttackers(square, attacker, occupancies[ALL])) { attacked |= 1ull << square; }
 	}
-	if (batk & bitboards[q - 6 * attacker])
+	return attacked;
+}
+
+// Squares among the given ones that the king of the side to move can step onto (sliders see through the square the king leaves)
+uint64_t Game::getSafeKingSquares(Bitboard squares) const
+{
+	int kingSquare = getLeastSignificantBitIndex(bitboards[side == WHITE ? K : k]);
+
+	Bitboard safe = 0ull;
+	Bitboard occupancy = occupancies[ALL] ^ (1ull << kingSquare);
+	while (squares)
 	{
-		queenCheck = batk & (batk & bitboards[q - 6 * attacker] | generateBishopAttacks(getLeastSignificantBitIndex(batk & bitboards[q - 6 * attacker]), occupancies[ALL]));
+		int square = popLeastSignificantBit(squares);
+		if (!getAttackers(square, side ^ 1, occupancy)) { safe |= 1ull << square; }
 	}
-	if (ratk & bitboards[q - 6 * attacker])
+	return safe;
+}
+
+// Fill in the cached pinned pieces of the side to move
+void Game::computePinned() const
+{
+	pinnedPieces = getPinnedPieces(getLeastSignificantBitIndex(bitboards[side == WHITE ? K : k]));
+	pinnedKnown = 1;
+}
+
+// En passant removes two pieces from a line at once, so its legality is checked on the board after the capture
+int Game::isEnPassantLegal(int start, int kingSquare)
+{
+	int capturedSquare = (side == WHITE ? enPassantSquare - 8 : enPassantSquare + 8);
+	Bitboard occupancy = (occupancies[ALL] ^ (1ull << start) ^ (1ull << capturedSquare)) | (1ull << enPassantSquare);
+
+	return (getAttackers(kingSquare, side ^ 1, occupancy) & ~(1ull << capturedSquare)) == 0;
+}
+
+// Check that a pseudo legal move doesn't leave the king in check
+int Game::isLegal(int move)
+{
+	int start = getStartSquare(move);
+	int end = getEndSquare(move);
+	int piece = getPiece(move);
+	int kingSquare = getLeastSignificantBitIndex(bitboards[side == WHITE ? K : k]);
+
+	// Castling already checks the squares the king passes
+	if (getCastlingFlag(move)) { return 1; }
+	if (piece == K || piece == k) { return getSafeKingSquares(1ull << end) != 0; }
+	if (getEnpassantFlag(move)) { return isEnPassantLegal(start, kingSquare); }
+
+	// Other pieces have to capture the only checker or block its check
+	if (checkers)
 	{
-		queenCheck = ratk & (ratk & bitboards[q - 6 * attacker] | generateRookAttacks(getLeastSignificantBitIndex(ratk & bitboards[q - 6 * attacker]), occupancies[ALL]));
+		if (checkers & (checkers - 1)) { return 0; }
+		if (!getBit(checkers | BETWEEN_MASKS[kingSquare][getLeastSignificantBitIndex(checkers)], end)) { return 0; }
 	}
 
-	return leaperCheck | bishopCheck | rookCheck | queenCheck;
+	// Pinned pieces can only move along the pin
+	if (getBit(getPinned(), start) && !getBit(LINE_MASKS[kingSquare][start], end)) { return 0; }
+
+	return 1;
 }
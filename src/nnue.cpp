@@ -0,0 +1,205 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "utils.h"
+#include "movegen.h"
+#include "nnue.h"
+
+using std::cout;
+using std::endl;
+
+int NNUE::enabled = 0;
+
+Network NETWORK;
+
+// Every search thread works on its own accumulators
+thread_local Accumulator ACCUMULATOR_STACK[NNUE_STACK_SIZE];
+
+// Load a network file, the hand-written evaluation stays in use if it can't be read
+int NNUE::load(std::string path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		cout << "info string could not open network file " << path << endl;
+		return 0;
+	}
+
+	const size_t count = NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN + 1;
+	if ((size_t)file.tellg() != count * sizeof(int16_t))
+	{
+		cout << "info string " << path << " is not a " << NNUE_INPUTS << "x" << NNUE_HIDDEN << " network" << endl;
+		return 0;
+	}
+
+	std::vector<int16_t> buffer(count);
+	file.seekg(0);
+	if (!file.read((char*)buffer.data(), count * sizeof(int16_t)))
+	{
+		cout << "info string could not read network file " << path << endl;
+		return 0;
+	}
+
+	const int16_t* data = buffer.data();
+	memcpy(NETWORK.featureWeights, data, sizeof(NETWORK.featureWeights));
+	data += NNUE_INPUTS * NNUE_HIDDEN;
+	memcpy(NETWORK.featureBias, data, sizeof(NETWORK.featureBias));
+	data += NNUE_HIDDEN;
+	memcpy(NETWORK.outputWeights, data, sizeof(NETWORK.outputWeights));
+	data += 2 * NNUE_HIDDEN;
+	NETWORK.outputBias = *data;
+
+	enabled = 1;
+	return 1;
+}
+
+// Go back to the hand-written evaluation
+void NNUE::unload()
+{
+	enabled = 0;
+}
+
+// Compute the accumulator of the current position from scratch
+void NNUE::refreshAccumulator(Game& game)
+{
+	Accumulator& accumulator = ACCUMULATOR_STACK[game.accumulatorIndex];
+
+	for (int perspective = BLACK; perspective <= WHITE; perspective ++)
+	{
+		int16_t* values = accumulator.values[perspective];
+		memcpy(values, NETWORK.featureBias, sizeof(NETWORK.featureBias));
+
+		for (int piece = P; piece <= k; piece ++)
+		{
+			Bitboard bb = game.bitboards[piece];
+			while (bb)
+			{
+				int square = getLeastSignificantBitIndex(bb);
+				const int16_t* weights = NETWORK.featureWeights[getFeatureIndex(perspective, piece, square)];
+				for (int i = 0; i < NNUE_HIDDEN; i ++) { values[i] += weights[i]; }
+				bb = popBit(bb, square);
+			}
+		}
+	}
+}
+
+// Push the accumulator of the position after the move (called by makeMove once the board has been updated)
+void NNUE::updateAccumulator(Game& game, int move)
+{
+	int start = getStartSquare(move);
+	int end = getEndSquare(move);
+	int piece = getPiece(move);
+	int promotion = getPromotion(move);
+	int capturedPiece = getCapturedPiece(move);
+
+	// A move removes at most two features and adds at most two
+	int added[2][2] = {}, removed[2][2] = {};
+	int addCount = 0, removeCount = 0;
+
+	removed[removeCount][0] = piece, removed[removeCount ++][1] = start;
+	added[addCount][0] = (promotion != NULL_PIECE ? promotion : piece), added[addCount ++][1] = end;
+
+	if (getCaptureFlag(move))
+	{
+		int captureSquare = end;
+		if (getEnpassantFlag(move)) { captureSquare = (piece == P ? end - 8 : end + 8); }
+		removed[removeCount][0] = capturedPiece, removed[removeCount ++][1] = captureSquare;
+	}
+
+	if (getCastlingFlag(move))
+	{
+		int rook = (piece == K ? R : r);
+		int rookStart = (end == G1 ? H1 : end == C1 ? A1 : end == G8 ? H8 : A8);
+		int rookEnd = (end == G1 ? F1 : end == C1 ? D1 : end == G8 ? F8 : D8);
+		removed[removeCount][0] = rook, removed[removeCount ++][1] = rookStart;
+		added[addCount][0] = rook, added[addCount ++][1] = rookEnd;
+	}
+
+	const Accumulator& parent = ACCUMULATOR_STACK[game.accumulatorIndex];
+	game.accumulatorIndex = (game.accumulatorIndex + 1) & (NNUE_STACK_SIZE - 1);
+	Accumulator& child = ACCUMULATOR_STACK[game.accumulatorIndex];
+
+	for (int perspective = BLACK; perspective <= WHITE; perspective ++)
+	{
+		const int16_t* add0 = NETWORK.featureWeights[getFeatureIndex(perspective, added[0][0], added[0][1])];
+		const int16_t* sub0 = NETWORK.featureWeights[getFeatureIndex(perspective, removed[0][0], removed[0][1])];
+		const int16_t* from = parent.values[perspective];
+		int16_t* to = child.values[perspective];
+
+		for (int i = 0; i < NNUE_HIDDEN; i ++) { to[i] = from[i] + add0[i] - sub0[i]; }
+
+		if (removeCount == 2)
+		{
+			const int16_t* sub1 = NETWORK.featureWeights[getFeatureIndex(perspective, removed[1][0], removed[1][1])];
+			for (int i = 0; i < NNUE_HIDDEN; i ++) { to[i] -= sub1[i]; }
+		}
+		if (addCount == 2)
+		{
+			const int16_t* add1 = NETWORK.featureWeights[getFeatureIndex(perspective, added[1][0], added[1][1])];
+			for (int i = 0; i < NNUE_HIDDEN; i ++) { to[i] += add1[i]; }
+		}
+	}
+}
+
+// Dot product of the clipped (0 - QA) accumulator with the output weights
+static inline int getClippedDotProduct(const int16_t* values, const int16_t* weights)
+{
+#if defined(__AVX2__)
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ceiling = _mm256_set1_epi16(NNUE_QA);
+	__m256i sum = _mm256_setzero_si256();
+
+	for (int i = 0; i < NNUE_HIDDEN; i += 16)
+	{
+		__m256i v = _mm256_load_si256((const __m256i*)(values + i));
+		v = _mm256_min_epi16(_mm256_max_epi16(v, zero), ceiling);
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, _mm256_load_si256((const __m256i*)(weights + i))));
+	}
+
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ceiling = _mm_set1_epi16(NNUE_QA);
+	__m128i sum = _mm_setzero_si128();
+
+	for (int i = 0; i < NNUE_HIDDEN; i += 8)
+	{
+		__m128i v = _mm_load_si128((const __m128i*)(values + i));
+		v = _mm_min_epi16(_mm_max_epi16(v, zero), ceiling);
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(v, _mm_load_si128((const __m128i*)(weights + i))));
+	}
+
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+	return _mm_cvtsi128_si32(sum);
+#else
+	int sum = 0;
+	for (int i = 0; i < NNUE_HIDDEN; i ++)
+	{
+		sum += std::min(std::max((int)values[i], 0), NNUE_QA) * weights[i];
+	}
+	return sum;
+#endif
+}
+
+// Evaluate the position from the side to move's point of view
+int NNUE::evaluate(const Game& game)
+{
+	const Accumulator& accumulator = ACCUMULATOR_STACK[game.accumulatorIndex];
+
+	int output = getClippedDotProduct(accumulator.values[game.side], NETWORK.outputWeights[0])
+			   + getClippedDotProduct(accumulator.values[game.side ^ 1], NETWORK.outputWeights[1])
+			   + NETWORK.outputBias;
+
+	int score = (int)((int64_t)output * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+
+	return std::max(-NNUE_MAX_SCORE, std::min(NNUE_MAX_SCORE, score));
+}
@@ -0,0 +1,58 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <cstdint>
+#include <string>
+
+// Efficiently updatable neural network (768 -> 2x256 -> 1), an optional replacement of the hand-written evaluation
+namespace NNUE
+{
+	extern int enabled;
+	int load(std::string path);
+	void unload();
+	void refreshAccumulator(Game& game);
+	void updateAccumulator(Game& game, int move);
+	int evaluate(const Game& game);
+}
+
+// Network architecture: one input per (piece, square) seen from each side, a hidden layer per side and one output
+const int NNUE_INPUTS = 768;
+const int NNUE_HIDDEN = 256;
+
+// Quantization of the feature transformer (QA) and the output layer (QB), and the scale from network output to centipawns
+const int NNUE_QA = 255;
+const int NNUE_QB = 64;
+const int NNUE_SCALE = 400;
+
+// Network scores are clipped well below mate scores (and into the 16 bits of an eval cache entry)
+const int NNUE_MAX_SCORE = 20000;
+
+// Accumulators live on a per thread stack indexed by Game::accumulatorIndex, makeMove pushes and takeBack pops
+// (a ring, so that long move lists in position commands just wrap around)
+const int NNUE_STACK_SIZE = 256;
+
+// Network file layout (little endian int16): feature weights [768][256], feature bias [256], output weights [2][256], output bias
+struct alignas(64) Network
+{
+	int16_t featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+	int16_t featureBias[NNUE_HIDDEN];
+	int16_t outputWeights[2][NNUE_HIDDEN];
+	int16_t outputBias;
+};
+
+// First layer output, one half per perspective [BLACK / WHITE]
+struct alignas(64) Accumulator
+{
+	int16_t values[2][NNUE_HIDDEN];
+};
+
+// Index of a piece on a square as seen by one side (own pieces first, the board flipped for black)
+static inline int getFeatureIndex(int perspective, int piece, int square)
+{
+	int color = (piece <= K ? WHITE : BLACK);
+	int pieceType = piece % 6;
+	if (perspective == BLACK) { square ^= 56; }
+	return (color == perspective ? 0 : 384) + pieceType * 64 + square;
+}
+
+#endif
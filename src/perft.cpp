@@ -41,16 +41,15 @@ void Perft::perft_driver(int depth)
 {
 	if (depth == 0) { nodesSearched ++ ; return; }
 
-	game.generateAllMoves();
-	int *move = game.moveList;
-	while (*move != 0)
+	MoveList moveList;
+	if (game.checkers) { game.generateEvasions(moveList); }
+	else { game.generateAllMoves(moveList); }
+	// Only legal moves are generated, so the last ply can just be counted
+	if (depth == 1) { nodesSearched += moveList.count; return; }
+	int *move = moveList.moves;
+	while (move != moveList.moves + moveList.count)
 	{
 		GameState prevState = game.makeMove(*move, ALL_MOVES);
-		if (!prevState.valid)
-		{
-			move++;
-			continue;
-		}
 		perft_driver(depth - 1);
 		game.takeBack(prevState);
 		move++;
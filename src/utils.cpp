@@ -27,7 +27,7 @@ void displayBitboard(uint64_t board)
 }
 
 // Display game
-void displayGame(Game game)
+void displayGame(const Game& game)
 {
 	int index;
 	string osName;
@@ -79,13 +79,13 @@ void displayGame(Game game)
 	cout << endl;
 }
 
-void printMoveList(Game game)
+void printMoveList(const MoveList& moveList)
 {
 	cout << endl;
 	cout << "     Move   P.  Pr.  Cp.  Cf.  DP.  Ep.  Cs.\n" << endl;
 	int i = 1;
-	int *p = game.moveList;
-	while (*p != 0)
+	const int *p = moveList.moves;
+	while (p != moveList.moves + moveList.count)
 	{
 		if (i < 10) { cout << " " << i << "   "; }
 		else { cout << i << "   "; }
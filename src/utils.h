@@ -79,7 +79,7 @@ enum CastlingRights {
 };
 
 enum MoveType {
-	ALL_MOVES, ONLY_CAPTURES
+	ALL_MOVES, ONLY_CAPTURES, ONLY_QUIETS
 };
 
 // game phases
@@ -87,21 +87,92 @@ enum GamePhase {
 	OPENING, ENDGAME, MIDDLEGAME 
 };
 
-// GameState structure used to store previous game state
+// Starting value of pawn keys, so that positions without pawns don't hash to zero like an empty hash table slot
+const uint64_t NO_PAWNS_KEY = 0x9d39247e33776d41ull;
+
+// Seed of the Zobrist keys, every game uses the same keys so that hash keys stay valid across positions and runs
+const uint32_t ZOBRIST_SEED = 1804289383;
+
+// Zobrist keys shared by all games, generated at compile time with an xorshift64* generator
+struct ZobristKeys
+{
+	uint64_t pieceKey[12][64];
+	uint64_t enPassantKey[64];
+	uint64_t sideKey;
+	uint64_t castleKey[16];
+};
+
+constexpr uint64_t generateZobristKey(uint64_t& state)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 2685821657736338717ull;
+}
+
+constexpr ZobristKeys generateZobristKeys()
+{
+	ZobristKeys keys = {};
+	uint64_t state = ZOBRIST_SEED;
+
+	for (int piece = 0; piece < 12; piece ++)
+	{
+		for (int square = 0; square < 64; square ++)
+		{
+			keys.pieceKey[piece][square] = generateZobristKey(state);
+		}
+	}
+	for (int square = 0; square < 64; square ++)
+	{
+		keys.enPassantKey[square] = generateZobristKey(state);
+	}
+	keys.sideKey = generateZobristKey(state);
+	for (int i = 0; i < 16; i ++)
+	{
+		keys.castleKey[i] = generateZobristKey(state);
+	}
+
+	return keys;
+}
+
+inline constexpr ZobristKeys ZOBRIST_KEYS = generateZobristKeys();
+inline constexpr const uint64_t (&PIECE_KEY)[12][64] = ZOBRIST_KEYS.pieceKey;
+inline constexpr const uint64_t (&ENPASSANT_KEY)[64] = ZOBRIST_KEYS.enPassantKey;
+inline constexpr const uint64_t (&CASTLE_KEY)[16] = ZOBRIST_KEYS.castleKey;
+inline constexpr const uint64_t& SIDE_KEY = ZOBRIST_KEYS.sideKey;
+
+// Size of move lists (no position has more than 218 legal moves)
+const int MAX_MOVES = 256;
+
+// Moves generated for one position (each search ply has its own list)
+struct MoveList
+{
+	int moves[MAX_MOVES];
+	// Ordering score of each move, filled in once by the search before picking moves
+	int scores[MAX_MOVES];
+	int count;
+};
+
+// Undo record of a move: everything makeMove changes that takeBack can't get back by flipping the squares of the move
 struct GameState
 {
 	int valid;
-	uint64_t bitboards[12];
-	uint64_t occupancies[3];
-	int moveList[150];
+	int move;
 	int side;
 	int enPassantSquare;
 	int castlingRights;
 	int moveNum;
 	int fiftyMoveRuleCount;	
 	uint64_t hashKey;
+	uint64_t pawnKey;
+	uint64_t materialKey;
 	int gamePhaseScore;
-	uint64_t checkMask;
+	int openingScore;
+	int endgameScore;
+	int accumulatorIndex;
+	uint64_t checkers;
+	uint64_t pinnedPieces;
+	int pinnedKnown;
 };
 
 class Game
@@ -113,21 +184,30 @@ public:
 	int castlingRights = 0b1111;
 	uint64_t bitboards[12] = {0ull};
 	uint64_t occupancies[3] = {0ull};
-	int moveList[150];
 	int moveNum = 0;
 	int fiftyMoveRuleCount = 0;
-	uint64_t checkMask = 0ull;
+	// Enemy pieces giving check to the side to move (every node needs them, so makeMove computes them right away)
+	uint64_t checkers = 0ull;
+	// Pieces of the side to move pinned to their king, only computed once move generation or a legality check asks for them
+	// (also through const references), and kept until the position changes
+	mutable uint64_t pinnedPieces = 0ull;
+	mutable int pinnedKnown = 0;
 
 	// for generating trasposition tables
 	uint64_t hashKey = 0ull;
-	uint64_t PIECE_KEY[12][64];
-	uint64_t ENPASSANT_KEY[64];
-	uint64_t CASTLE_KEY[16];
-	uint64_t SIDE_KEY;
+	uint64_t pawnKey = NO_PAWNS_KEY;
+	uint64_t materialKey = 0ull;
 
 	// Get value right after make move
 	int gamePhaseScore = 6766;
 
+	// Material and positional scores of both phases (from white's point of view)
+	int openingScore = 0;
+	int endgameScore = 0;
+
+	// Position of the NNUE accumulator on the search thread's accumulator stack
+	int accumulatorIndex = 0;
+
 	// Construct instance with fen or start position
 	Game();
 	Game(std::string fen);
@@ -136,18 +216,47 @@ public:
 
 	// Initialize bitboards
 	void initPieceBitboards();
-	void initHashKey();
-	uint64_t generateHashKey();
+	uint64_t generateHashKey() const;
+	uint64_t generatePawnKey() const;
+	uint64_t generateMaterialKey() const;
 
 	// Move generation
-	void generateAllMoves();
+	void generateAllMoves(MoveList& moveList, int moveType = ALL_MOVES);
+	void generateEvasions(MoveList& moveList);
+	int isPseudoLegal(int move);
 	int getCaptures(int target, int attacker);
 	uint64_t isSquareAttacked(int square, int attacker);
-	uint64_t getCheckMask(int attacker);
-
+	uint64_t getAttackers(int square, int attacker, Bitboard occupancy) const;
+	uint64_t getCheckers();
+	uint64_t getPinnedPieces(int kingSquare) const;
+	uint64_t getAttackedSquares(Bitboard squares, int attacker) const;
+	uint64_t getSafeKingSquares(Bitboard squares) const;
+	void computePinned() const;
+	int isEnPassantLegal(int start, int kingSquare);
+	int isLegal(int move);
+
+	void addPiece(int piece, int square);
+	void removePiece(int piece, int square);
+	void saveState(GameState& state, int move);
 	GameState makeMove(int move, int moveType = ALL_MOVES);
 	GameState makeNullMove();
-	void takeBack(GameState prevState);
+	void takeBack(const GameState& prevState);
+
+	// Pinned pieces of the side to move (see pinnedPieces)
+	inline uint64_t getPinned() const
+	{
+		if (!pinnedKnown) { computePinned(); }
+		return pinnedPieces;
+	}
+
+	// Flip a piece on a square in its bitboard and the occupancies
+	inline void togglePiece(int piece, int square)
+	{
+		Bitboard bit = 1ull << square;
+		bitboards[piece] ^= bit;
+		occupancies[piece <= K ? WHITE : BLACK] ^= bit;
+		occupancies[ALL] ^= bit;
+	}
 };
 
 
@@ -158,25 +267,22 @@ public:
 **********************************************************/
 
 // Check if a bitboard contains a certain bit (square)
-static inline uint64_t getBit(uint64_t board, int square) { return board & (1ull << square); }
+static constexpr uint64_t getBit(uint64_t board, int square) { return board & (1ull << square); }
 // Set a bit at a given index in the bitboard
-static inline uint64_t setBit(uint64_t board, int square) { return board | (1ull << square); }
+static constexpr uint64_t setBit(uint64_t board, int square) { return board | (1ull << square); }
 // Remove a bit at a given index in the bitboard
-static inline uint64_t popBit(uint64_t board, int square) { return board & ~(1ull << square); }
-// Count bits that are 1 in a bitboard
-static inline int countBits(uint64_t board)
+static constexpr uint64_t popBit(uint64_t board, int square) { return board & ~(1ull << square); }
+// Count bits that are 1 in a bitboard (a single popcnt instruction in builds for x86-64-v2 and up)
+static constexpr int countBits(uint64_t board) { return __builtin_popcountll(board); }
+// Retrieve the index of the least significant bit in a bitboard (bsf / tzcnt)
+static constexpr int getLeastSignificantBitIndex(uint64_t board) { return (board ? __builtin_ctzll(board) : -1); }
+// Remove the least significant bit of a bitboard and return its index (blsr in builds for x86-64-v3)
+static inline int popLeastSignificantBit(uint64_t& board)
 {
-	int count = 0;
-	while (board)
-	{
-		// This operation removes the last (right-most) bit every time
-		board &= board - 1;
-		count ++;
-	}
-	return count;	
+	int square = __builtin_ctzll(board);
+	board &= board - 1;
+	return square;
 }
-// Retrieve the index of the least significant bit in a bitboard
-static inline int getLeastSignificantBitIndex(uint64_t board) { return (board ? countBits((board & -board) - 1) : -1); }
 
 
 /*********************************************************
@@ -244,9 +350,9 @@ const uint64_t TRICY_POSITION_PERFT[6] = {48, 2039, 97862, 4085603, 193690690, 8
 // Display bitboard in 8 x 8 style
 void displayBitboard(uint64_t board);
 // Display bitboard in 8 x 8 style
-void displayGame(Game game);
+void displayGame(const Game& game);
 // Display move list
-void printMoveList(Game game);
+void printMoveList(const MoveList& moveList);
 
 const std::string ASCII_PIECES[13] = {"P","N","B","R","Q","K","p","n","b","r","q","k","-"};
 